@@ -8,37 +8,154 @@
 #define HASHMAP_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #define HASHMAP_MAX_CHAIN_LENGTH 8
+// keys hashed side by side by the batch kernel
+#define HASHMAP_BATCH_LANES 4
+// random buckets tried per sample before falling back to the next used bucket
+#define HASHMAP_SAMPLE_TRIES 32
+// number of buckets covered by one bit of the dirty bitmap ( ~3KB of data )
+#define HASHMAP_DIRTY_RANGE 128
+// slots after the buckets taking the keys whose probe window is full
+#define HASHMAP_STASH_SIZE 16
+// load factor up to which a full probe window goes to the stash instead of expanding
+#define HASHMAP_STASH_MAX_LOAD 0.5
+// most entries of a front cache, 16M entries of 16 bytes
+#define HASHMAP_FRONT_MAX_ENTRIES (1u << 24)
+// tables of at least this many bytes are mapped, so a shrink can give pages back
+#define HASHMAP_MMAP_THRESHOLD (1 << 20)
+// highest low-water mark, a halved table must stay well below HASHMAP_STASH_MAX_LOAD
+#define HASHMAP_SHRINK_MAX_LOW_WATER 0.2f
+// tables never shrink below this
+#define HASHMAP_SHRINK_MIN_SIZE 16
+// a table of n buckets shrinks after at least n / HASHMAP_SHRINK_REMOVALS removes
+#define HASHMAP_SHRINK_REMOVALS 64
+// hashmapMaintain grows a table ahead of time once this many keys are stashed
+#define HASHMAP_MAINTAIN_STASH_FILL (HASHMAP_STASH_SIZE / 2)
+// cost of a rehash per bucket assumed until hashmapMaintain has timed one
+#define HASHMAP_MAINTAIN_NS_PER_SLOT 10.0
 
 typedef struct {
     const char* key;
     unsigned keyLen;
     bool used;
+    unsigned char probeDist;  // distance from the home bucket, fits in the padding
+    uint16_t fingerprint;     // hash bits compared before the key, fills the rest of the padding
     void* data;
 } HashmapElement;
 
+// a hash function fed a key in pieces: update(update(seed, a), b) == update(seed, ab)
+typedef struct {
+    const char* name;
+    unsigned seed;
+    unsigned (*update)(unsigned state, const char* const s, const unsigned len);
+} HashmapHasher;
+
+// samples keys to pick a hasher, see hashmapHasher.h
+typedef struct HashmapTuner HashmapTuner;
+
+// holds the keys of a hashmap that owns them, see hashmapArena.h
+typedef struct HashmapKeyArena HashmapKeyArena;
+
+// tracks which bucket ranges changed since the last checkpoint
+typedef struct {
+    unsigned rangeCount;
+    unsigned checkpoints;
+    unsigned char bits[];
+} HashmapDirty;
+
+// remembers the bucket of recently found keys, by key pointer
+typedef struct {
+    const char* key;
+    unsigned len;
+    unsigned slot;
+} HashmapFrontEntry;
+
+typedef struct {
+    unsigned mask;
+    HashmapFrontEntry entries[];
+} HashmapFrontCache;
+
+// data holds the tableSize buckets followed by the HASHMAP_STASH_SIZE stash slots
 typedef struct {
     unsigned tableSize;
     unsigned size;
+    unsigned stashed;
     HashmapElement* data;
+    HashmapDirty* dirty;
+    const HashmapHasher* hasher;
+    HashmapTuner* tuner;
+    HashmapFrontCache* front;
+    HashmapKeyArena* arena;
+    float lowWater;       // load factor under which removes shrink the table, 0 to never shrink
+    unsigned removals;    // since the last resize
+    size_t mappedBytes;   // size of the mapping holding data, 0 if allocated
 } Hashmap;
 
+// a piece of a key, a key given in fragments is their concatenation
+typedef struct {
+    const char* bytes;
+    unsigned len;
+} HashmapKeyFragment;
+
+// the hash of a key fed in pieces, see hashmapHashInit
+typedef struct {
+    const HashmapHasher* hasher;
+    unsigned state;
+    unsigned len;  // fed so far
+} HashmapHashState;
+
+// gets the current value of a key in *value, see hashmapCompute for the return value
+typedef int (*HashmapComputeFunction)(void* const context, void** const value, const bool found);
+
 int hashmapCreate(const unsigned initialSize, Hashmap* const outHashmap);
 int hashmapPut(Hashmap* const hashmap, const char* const key, const unsigned len, void* const value);
+int hashmapPutHashed(Hashmap* const hashmap, unsigned hash, const char* const key, const unsigned len, void* const value);
 void* hashmapGet(const Hashmap* const hashmap, const char* const key, const unsigned len);
+void* hashmapGetHashed(const Hashmap* const hashmap, const unsigned hash, const char* const key, const unsigned len);
 int hashmapRemove(Hashmap* const hashmap, const char* const key, const unsigned len);
+int hashmapCompute(Hashmap* const hashmap, const char* const key, const unsigned len, HashmapComputeFunction f, void* const context);
 void hashmapDestroy(Hashmap* const hashmap);
 
-bool hashmapCheckIfMatch(const HashmapElement* const element, const char* const key, const unsigned len);
+int hashmapPutFragments(Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count, void* const value);
+int hashmapPutHashedFragments(Hashmap* const hashmap, unsigned hash, const HashmapKeyFragment* const fragments, const unsigned count, void* const value);
+void* hashmapGetFragments(const Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count);
+void* hashmapGetHashedFragments(const Hashmap* const hashmap, const unsigned hash, const HashmapKeyFragment* const fragments, const unsigned count);
+int hashmapRemoveFragments(Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count);
+
+bool hashmapCheckIfMatch(const HashmapElement* const element, const uint16_t fingerprint, const char* const key, const unsigned len);
 
 unsigned hashmapCRC32(const char* const s, const unsigned len);
+unsigned hashmapCRC32Update(const unsigned crc, const char* const s, const unsigned len);
+void hashmapCRC32Batch(const char* const* const keys, const unsigned* const lens, const unsigned count, unsigned* const outCrcs);
+unsigned hashmapHash(const Hashmap* const m, const char* const keystring, const unsigned len);
+void hashmapHashInit(const Hashmap* const hashmap, HashmapHashState* const state);
+void hashmapHashUpdate(HashmapHashState* const state, const char* const s, const unsigned len);
+unsigned hashmapHashFinal(const HashmapHashState* const state);
+void hashmapHashBatch(const Hashmap* const m, const char* const* const keys, const unsigned* const lens, const unsigned count, unsigned* const outHashes);
+uint16_t hashmapFingerprint(const unsigned hash);
 unsigned hashmapStringHasher(const Hashmap* const m, const char* const keystring, const unsigned len);
 bool hashmapGetBucket(const Hashmap* const m, const char* const key, const unsigned len, unsigned* const out_index);
+bool hashmapGetBucketFrom(const Hashmap* const m, const unsigned hash, const char* const key, const unsigned len, unsigned* const out_index);
 
 int hashmapApplyIterator(Hashmap* const hashmap, int (*f)(void* const, HashmapElement* const), void* const context);
+unsigned hashmapScan(Hashmap* const hashmap, unsigned cursor, unsigned count, int (*f)(void* const, HashmapElement* const), void* const context);
+unsigned hashmapSampleRandom(const Hashmap* const hashmap, const unsigned k, HashmapElement** const out, uint64_t* const rngState);
 int hashmapRehashIterator(void* const newHashmap, HashmapElement* const element);
 
 int hashmapExpand(Hashmap* const m);
+int hashmapShrink(Hashmap* const hashmap);
+int hashmapAutoShrink(Hashmap* const hashmap, const float lowWater);
+unsigned hashmapSlotCount(const Hashmap* const hashmap);
+int hashmapMaintain(Hashmap* const hashmap, const uint64_t budgetNs);
+
+int hashmapEnableFrontCache(Hashmap* const hashmap, const unsigned entries);
+
+int hashmapTrackDirty(Hashmap* const hashmap);
+void hashmapMarkDirty(Hashmap* const hashmap, const unsigned index);
+bool hashmapIsRangeDirty(const Hashmap* const hashmap, const unsigned range);
+void hashmapClearDirty(Hashmap* const hashmap);
 
 int logFreeIterator(void* const context, HashmapElement* const elem);
 void hashmapDestroyWithOwnership(Hashmap* const hashmap, int (*iterator)(void* const, HashmapElement* const));
@@ -0,0 +1,56 @@
+/**
+ * @file hashmapArena.h
+ * @brief Implements the arena holding the keys of a hashmap that owns them
+ *
+ * A hashmap owning its keys copies every new key into chunks of a bump
+ * allocator, so callers can pass keys that don't outlive the put. Removed
+ * keys can't be given back to a bump allocator, the arena only counts their
+ * bytes as dead, along with the chunk tails too short for the next key.
+ *
+ * Once the dead bytes pass HASHMAP_ARENA_DEAD_RATIO of the live ones, the
+ * next hashmapExpand copies the live keys into a fresh arena while it
+ * rehashes them. hashmapCompact does the same for a hashmap that no longer
+ * grows. Both move the keys, so key pointers read from the hashmap before
+ * ( elements, sorted keys, samples ) are stale afterwards.
+ */
+#ifndef HASHMAP_ARENA_H
+#define HASHMAP_ARENA_H
+
+#include <stddef.h>
+
+#include "hashmap.h"
+
+// size of the chunks keys are copied into
+#define HASHMAP_ARENA_CHUNK (64 * 1024)
+// keys bigger than this get a chunk of their own
+#define HASHMAP_ARENA_BIG_KEY (HASHMAP_ARENA_CHUNK / 4)
+// dead bytes, relative to the live ones, that make the arena worth compacting
+#define HASHMAP_ARENA_DEAD_RATIO 0.5
+// fewer dead bytes than this are never worth a compaction
+#define HASHMAP_ARENA_MIN_DEAD HASHMAP_ARENA_CHUNK
+
+typedef struct HashmapArenaChunk {
+    struct HashmapArenaChunk* next;
+    size_t size;
+    size_t used;
+    char bytes[];
+} HashmapArenaChunk;
+
+struct HashmapKeyArena {
+    HashmapArenaChunk* chunks;  // the one being filled first
+    size_t liveBytes;
+    size_t deadBytes;
+    size_t reservedBytes;
+};
+
+int hashmapOwnKeys(Hashmap* const hashmap);
+int hashmapCompact(Hashmap* const hashmap);
+
+HashmapKeyArena* hashmapArenaCreate(const size_t capacity);
+char* hashmapArenaReserve(HashmapKeyArena* const arena, const unsigned len);
+const char* hashmapArenaCopy(HashmapKeyArena* const arena, const char* const key, const unsigned len);
+void hashmapArenaRelease(HashmapKeyArena* const arena, const unsigned len);
+bool hashmapArenaFragmented(const HashmapKeyArena* const arena);
+void hashmapArenaFree(HashmapKeyArena* const arena);
+
+#endif  // HASHMAP_ARENA_H
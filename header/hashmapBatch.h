@@ -0,0 +1,16 @@
+/**
+ * @file hashmapBatch.h
+ * @brief Implements batched gets and puts fed by the multi-key hashing kernel
+ */
+#ifndef HASHMAP_BATCH_H
+#define HASHMAP_BATCH_H
+
+#include "hashmap.h"
+
+// keys hashed and prefetched together before probing
+#define HASHMAP_BATCH_SIZE 16
+
+void hashmapGetBatch(const Hashmap* const hashmap, const char* const* const keys, const unsigned* const lens, const unsigned count, void** const outValues);
+int hashmapPutBatch(Hashmap* const hashmap, const char* const* const keys, const unsigned* const lens, void* const* const values, const unsigned count);
+
+#endif  // HASHMAP_BATCH_H
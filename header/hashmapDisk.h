@@ -0,0 +1,95 @@
+/**
+ * @file hashmapDisk.h
+ * @brief Implements a disk resident hashmap using extendible hashing
+ *
+ * The buckets are fixed size pages of a file. An in-memory directory of
+ * 2^globalDepth page numbers is indexed by the low bits of the key hash, a
+ * page with a local depth d holds every key whose low d bits are its prefix.
+ * A full page splits alone on the next bit, doubling the directory only when
+ * its local depth was the global one, so growing never rewrites the file.
+ *
+ * Pages are read through a page cache of a fixed number of frames with clock
+ * eviction, or accessed in place in a shared mapping of the file. Either way
+ * only the directory ( 4 bytes per entry ) has to fit in memory.
+ *
+ * Values are byte strings copied in and out, they can't be pointers since
+ * they outlive the process. A key and its value must fit in one page. Pages
+ * don't merge back when emptied by removes.
+ */
+#ifndef HASHMAP_DISK_H
+#define HASHMAP_DISK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+#define HASHMAP_DISK_MAGIC "HMDISK01"
+#define HASHMAP_DISK_PAGE 4096
+// the directory can't grow past 2^HASHMAP_DISK_MAX_DEPTH entries
+#define HASHMAP_DISK_MAX_DEPTH 30
+
+// page 0 of the file
+typedef struct {
+    char magic[8];
+    uint32_t pageSize;
+    uint32_t pageCount;
+    uint32_t size;
+} HashmapDiskHeader;
+
+// starts every bucket page, followed by the records
+typedef struct {
+    uint32_t localDepth;
+    uint32_t prefix;  // the low localDepth bits of the hash of every key of the page
+    uint16_t count;
+    uint16_t used;  // bytes of records
+} HashmapDiskPage;
+
+// a record, followed by the key then the value bytes
+typedef struct {
+    uint32_t hash;
+    uint16_t keyLen;
+    uint16_t valLen;
+} HashmapDiskRecord;
+
+// the largest key plus value that fits in a page
+#define HASHMAP_DISK_MAX_RECORD (HASHMAP_DISK_PAGE - sizeof(HashmapDiskPage) - sizeof(HashmapDiskRecord))
+
+typedef struct {
+    uint32_t page;  // 0 if the frame is empty
+    bool dirty;
+    bool referenced;
+    char* bytes;
+} HashmapDiskFrame;
+
+typedef struct {
+    int fd;
+    unsigned pageCount;
+    unsigned size;
+    unsigned globalDepth;
+    uint32_t* directory;
+
+    // mmap access, NULL when going through the page cache
+    char* mapping;
+    size_t mappingBytes;
+
+    // page cache, indexed by page number
+    HashmapDiskFrame* frames;
+    char* frameBytes;
+    unsigned frameCount;
+    unsigned hand;
+    Hashmap frameIndex;
+
+    unsigned long hits;
+    unsigned long misses;
+} HashmapDisk;
+
+int hashmapDiskOpen(const char* const path, const size_t cacheBytes, const bool useMmap, HashmapDisk* const outDisk);
+int hashmapDiskPut(HashmapDisk* const disk, const char* const key, const unsigned len, const void* const value, const unsigned valLen);
+int hashmapDiskGet(HashmapDisk* const disk, const char* const key, const unsigned len, void* const value, const unsigned capacity, unsigned* const outLen);
+int hashmapDiskRemove(HashmapDisk* const disk, const char* const key, const unsigned len);
+int hashmapDiskSync(HashmapDisk* const disk);
+int hashmapDiskClose(HashmapDisk* const disk);
+
+#endif  // HASHMAP_DISK_H
@@ -0,0 +1,70 @@
+/**
+ * @file hashmapExport.h
+ * @brief Implements a parallel export of a hashmap to Arrow compatible columns
+ *
+ * The keys follow the Arrow LargeBinary layout (length + 1 int64 offsets into
+ * a byte buffer) and the values the UInt64 layout. There are no nulls, so no
+ * validity bitmaps. The three buffers live in one 64 byte aligned block, each
+ * one starting on a 64 byte boundary, so the whole export can be written out
+ * or shared as a single region.
+ *
+ * A hashmap owning its keys can export them without copying them, as an
+ * Arrow BinaryView column: one 16 byte view per key, holding a key of up to
+ * HASHMAP_EXPORT_VIEW_INLINE bytes in place, and a longer one as its first 4
+ * bytes and a buffer index and offset. The buffers are the chunks of the key
+ * arena, so the views are only valid until the next change to the hashmap.
+ */
+#ifndef HASHMAP_EXPORT_H
+#define HASHMAP_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+#define HASHMAP_EXPORT_ALIGNMENT 64
+// keys up to this length are stored in their view
+#define HASHMAP_EXPORT_VIEW_INLINE 12
+
+typedef struct {
+    unsigned length;
+    int64_t* keyOffsets;
+    char* keyData;
+    uint64_t* values;
+    void* block;
+    size_t blockSize;
+} HashmapColumns;
+
+typedef union {
+    struct {
+        int32_t len;
+        char bytes[HASHMAP_EXPORT_VIEW_INLINE];
+    } inlined;
+    struct {
+        int32_t len;
+        char prefix[4];
+        int32_t buffer;
+        int32_t offset;
+    } ref;
+} HashmapKeyView;
+
+typedef struct {
+    unsigned length;
+    HashmapKeyView* keyViews;
+    uint64_t* values;
+    unsigned bufferCount;
+    const char** buffers;  // the chunks of the key arena, not copied
+    int64_t* bufferSizes;
+    void* block;
+    size_t blockSize;
+} HashmapKeyViewColumns;
+
+// returns the value column entry of an element, NULL exports the value pointers
+typedef uint64_t (*HashmapValueExtractor)(const void* const value, void* const context);
+
+int hashmapExportColumns(const Hashmap* const hashmap, HashmapValueExtractor extractor, void* const context, const unsigned threads, HashmapColumns* const outColumns);
+void hashmapColumnsFree(HashmapColumns* const columns);
+int hashmapExportKeyViews(const Hashmap* const hashmap, HashmapValueExtractor extractor, void* const context, const unsigned threads, HashmapKeyViewColumns* const outColumns);
+void hashmapKeyViewColumnsFree(HashmapKeyViewColumns* const columns);
+
+#endif  // HASHMAP_EXPORT_H
@@ -0,0 +1,41 @@
+/**
+ * @file hashmapHandle.h
+ * @brief Implements a handle to a read-only hashmap that can be replaced while readers use it
+ *
+ * Readers never wait: acquiring the map is one counter increment and one
+ * pointer load. A writer builds a new map privately, publishes it with a
+ * single atomic pointer swap and then waits for the readers of the old map
+ * to drain before destroying it.
+ *
+ * A published map is read through a const pointer by many threads at once,
+ * so it must not have a front cache: hashmapGet writes the cache even then.
+ * hashmapHandleCreate and hashmapHandlePublish refuse such a map.
+ */
+#ifndef HASHMAP_HANDLE_H
+#define HASHMAP_HANDLE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "hashmap.h"
+
+typedef struct {
+    _Atomic(Hashmap*) current;
+    atomic_uint epoch;
+    atomic_uint readers[2];
+    pthread_mutex_t publishLock;
+    int (*retireIterator)(void* const, HashmapElement* const);
+} HashmapHandle;
+
+typedef struct {
+    const Hashmap* map;
+    unsigned slot;
+} HashmapReadGuard;
+
+int hashmapHandleCreate(HashmapHandle* const outHandle, Hashmap* const initial, int (*retireIterator)(void* const, HashmapElement* const));
+HashmapReadGuard hashmapHandleAcquire(HashmapHandle* const handle);
+void hashmapHandleRelease(HashmapHandle* const handle, const HashmapReadGuard guard);
+int hashmapHandlePublish(HashmapHandle* const handle, Hashmap* const fresh);
+void hashmapHandleDestroy(HashmapHandle* const handle);
+
+#endif  // HASHMAP_HANDLE_H
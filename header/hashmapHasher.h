@@ -0,0 +1,46 @@
+/**
+ * @file hashmapHasher.h
+ * @brief Implements the candidate hashers and the auto-tune mode that picks one
+ *
+ * An auto-tuned hashmap copies the first HASHMAP_TUNE_SAMPLES keys inserted
+ * into it. At the next hashmapExpand, which rehashes everything anyway, every
+ * candidate is timed on the samples and its probe lengths are measured on a
+ * simulated table. The fastest candidate whose mean probe length stays within
+ * HASHMAP_TUNE_PROBE_SLACK of the best one becomes the hasher of the new table.
+ *
+ * A scan running across the expand that switches the hasher loses its
+ * guarantee to visit every element, since the elements don't just split into
+ * the doubled buckets.
+ */
+#ifndef HASHMAP_HASHER_H
+#define HASHMAP_HASHER_H
+
+#include "hashmap.h"
+
+// number of keys sampled before the tuner decides
+#define HASHMAP_TUNE_SAMPLES 256
+// fewer samples than this at an expand and the tuner waits for the next one
+#define HASHMAP_TUNE_MIN_SAMPLES 64
+// times each candidate hashes the samples
+#define HASHMAP_TUNE_ROUNDS 16
+// accepted mean probe length, relative to the best candidate
+#define HASHMAP_TUNE_PROBE_SLACK 1.25
+
+struct HashmapTuner {
+    unsigned count;
+    char* keys[HASHMAP_TUNE_SAMPLES];
+    unsigned lens[HASHMAP_TUNE_SAMPLES];
+};
+
+extern const HashmapHasher hashmapCRC32Hasher;
+extern const HashmapHasher hashmapFNV1aHasher;
+extern const HashmapHasher hashmapX31Hasher;
+
+int hashmapSetHasher(Hashmap* const hashmap, const HashmapHasher* const hasher);
+int hashmapAutoTune(Hashmap* const hashmap);
+
+void hashmapTuneRecord(HashmapTuner* const tuner, const char* const key, const unsigned len);
+const HashmapHasher* hashmapTuneChoose(const Hashmap* const hashmap);
+void hashmapTunerFree(HashmapTuner* const tuner);
+
+#endif  // HASHMAP_HASHER_H
@@ -0,0 +1,58 @@
+/**
+ * @file hashmapLinear.h
+ * @brief Implements a hashmap growing one bucket at a time with linear hashing
+ *
+ * The table starts with N buckets, a power of two, at level 0. A key goes to
+ * bucket hash mod N * 2^level, or hash mod N * 2^(level + 1) when that first
+ * bucket is before the split pointer. Every put that takes the load past
+ * HASHMAP_LINEAR_LOAD splits the bucket under the split pointer into itself
+ * and a new bucket at the end, then advances the pointer. Once every bucket
+ * of the level has split the level goes up and the pointer starts over.
+ *
+ * Growing never moves more than one bucket, and the buckets live in fixed
+ * segments of HASHMAP_LINEAR_SEGMENT, so memory grows a segment at a time
+ * instead of in 2x jumps. A bucket holds HASHMAP_LINEAR_SLOTS elements and
+ * chains overflow buckets for the keys it can't hold until it splits.
+ */
+#ifndef HASHMAP_LINEAR_H
+#define HASHMAP_LINEAR_H
+
+#include <stddef.h>
+
+#include "hashmap.h"
+
+// elements per bucket
+#define HASHMAP_LINEAR_SLOTS 4
+// buckets per segment, a power of two
+#define HASHMAP_LINEAR_SEGMENT 64
+// elements per bucket slot past which a put splits a bucket
+#define HASHMAP_LINEAR_LOAD 0.75
+
+// elements fill a chain in order, only the last bucket has free slots
+typedef struct HashmapLinearBucket {
+    HashmapElement slots[HASHMAP_LINEAR_SLOTS];
+    struct HashmapLinearBucket* overflow;
+} HashmapLinearBucket;
+
+typedef struct {
+    unsigned initialBuckets;
+    unsigned level;
+    unsigned split;
+    unsigned bucketCount;
+    unsigned size;
+    const HashmapHasher* hasher;
+    HashmapLinearBucket** segments;
+    unsigned segmentCount;
+    unsigned segmentCap;
+    size_t overflowCount;
+} HashmapLinear;
+
+int hashmapLinearCreate(const unsigned initialBuckets, HashmapLinear* const outHashmap);
+int hashmapLinearPut(HashmapLinear* const hashmap, const char* const key, const unsigned len, void* const value);
+void* hashmapLinearGet(const HashmapLinear* const hashmap, const char* const key, const unsigned len);
+int hashmapLinearRemove(HashmapLinear* const hashmap, const char* const key, const unsigned len);
+int hashmapLinearApplyIterator(HashmapLinear* const hashmap, int (*f)(void* const, HashmapElement* const), void* const context);
+size_t hashmapLinearMemory(const HashmapLinear* const hashmap);
+void hashmapLinearDestroy(HashmapLinear* const hashmap);
+
+#endif  // HASHMAP_LINEAR_H
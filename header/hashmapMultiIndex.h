@@ -0,0 +1,37 @@
+/**
+ * @file hashmapMultiIndex.h
+ * @brief Implements one set of records indexed both by a string key and by an integer field
+ *
+ * Each index is a plain Hashmap whose keys point inside the records, the
+ * string key and the bytes of the field, so a record is stored once and
+ * neither index copies anything. Both keys are unique, inserts and removes
+ * update the two indexes together. The key and the field of a record must
+ * not change while it is in the container.
+ */
+#ifndef HASHMAP_MULTI_INDEX_H
+#define HASHMAP_MULTI_INDEX_H
+
+#include "hashmap.h"
+
+// returns the string key of a record and its length in *outLen, pointing inside the record
+typedef const char* (*HashmapRecordKey)(const void* const record, unsigned* const outLen);
+// returns the integer field of a record, pointing inside the record
+typedef const unsigned* (*HashmapRecordField)(const void* const record);
+
+typedef struct {
+    Hashmap byKey;
+    Hashmap byField;
+    HashmapRecordKey key;
+    HashmapRecordField field;
+} HashmapMultiIndex;
+
+int hashmapMultiIndexCreate(const unsigned initialSize, HashmapRecordKey key, HashmapRecordField field, HashmapMultiIndex* const outIndex);
+int hashmapMultiIndexInsert(HashmapMultiIndex* const index, void* const record);
+void* hashmapMultiIndexGet(const HashmapMultiIndex* const index, const char* const key, const unsigned len);
+void* hashmapMultiIndexGetByField(const HashmapMultiIndex* const index, const unsigned field);
+int hashmapMultiIndexRemove(HashmapMultiIndex* const index, const char* const key, const unsigned len, void** const outRecord);
+int hashmapMultiIndexRemoveByField(HashmapMultiIndex* const index, const unsigned field, void** const outRecord);
+void hashmapMultiIndexDestroy(HashmapMultiIndex* const index);
+void hashmapMultiIndexDestroyWithOwnership(HashmapMultiIndex* const index, int (*iterator)(void* const, HashmapElement* const));
+
+#endif  // HASHMAP_MULTI_INDEX_H
@@ -0,0 +1,33 @@
+/**
+ * @file hashmapOverlay.h
+ * @brief Implements a mutable overlay over a shared read-only base hashmap
+ *
+ * Writes go to a small delta Hashmap and gets look there first, falling back
+ * to the base. Removing a key of the base puts a tombstone in the delta. The
+ * base is only read with hashmapGetHashed, which touches no front cache, so
+ * any number of overlays, on any threads, can share one base as long as
+ * nobody writes it. hashmapOverlayMerge folds the delta into a fresh base.
+ */
+#ifndef HASHMAP_OVERLAY_H
+#define HASHMAP_OVERLAY_H
+
+#include "hashmap.h"
+
+typedef struct {
+    const Hashmap* base;
+    Hashmap delta;  // tombstones are HASHMAP_OVERLAY_TOMBSTONE values
+    unsigned size;  // visible keys, base and delta together
+} HashmapOverlay;
+
+extern const char hashmapOverlayTombstone;
+#define HASHMAP_OVERLAY_TOMBSTONE ((void*)&hashmapOverlayTombstone)
+
+int hashmapOverlayCreate(const Hashmap* const base, const unsigned deltaSize, HashmapOverlay* const outOverlay);
+int hashmapOverlayPut(HashmapOverlay* const overlay, const char* const key, const unsigned len, void* const value);
+void* hashmapOverlayGet(const HashmapOverlay* const overlay, const char* const key, const unsigned len);
+int hashmapOverlayRemove(HashmapOverlay* const overlay, const char* const key, const unsigned len);
+int hashmapOverlayApplyIterator(HashmapOverlay* const overlay, int (*f)(void* const, HashmapElement* const), void* const context);
+int hashmapOverlayMerge(const HashmapOverlay* const overlay, Hashmap* const outBase);
+void hashmapOverlayDestroy(HashmapOverlay* const overlay);
+
+#endif  // HASHMAP_OVERLAY_H
@@ -0,0 +1,53 @@
+/**
+ * @file hashmapSharded.h
+ * @brief Implements a thread safe hashmap split into independently locked shards
+ *
+ * An optional maintenance thread visits the shards every interval and runs
+ * hashmapMaintain on each one whose lock is free, so the foreground puts
+ * rarely pay for an expand.
+ */
+#ifndef HASHMAP_SHARDED_H
+#define HASHMAP_SHARDED_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    Hashmap map;
+} HashmapShard;
+
+typedef struct HashmapShardedMaintainer HashmapShardedMaintainer;
+
+typedef struct {
+    unsigned shardCount;
+    unsigned shardBits;
+    HashmapShard* shards;
+    HashmapShardedMaintainer* maintainer;  // NULL without a maintenance thread
+} HashmapSharded;
+
+struct HashmapShardedMaintainer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stop;
+    unsigned intervalMs;
+    uint64_t budgetNs;  // per shard and visit
+    HashmapSharded* hashmap;
+};
+
+int hashmapShardedCreate(const unsigned shardCount, const unsigned initialSize, HashmapSharded* const outHashmap);
+HashmapShard* hashmapShardedShardFor(const HashmapSharded* const hashmap, const char* const key, const unsigned len);
+int hashmapShardedPut(HashmapSharded* const hashmap, const char* const key, const unsigned len, void* const value);
+void* hashmapShardedGet(HashmapSharded* const hashmap, const char* const key, const unsigned len);
+int hashmapShardedRemove(HashmapSharded* const hashmap, const char* const key, const unsigned len);
+int hashmapShardedCompute(HashmapSharded* const hashmap, const char* const key, const unsigned len, HashmapComputeFunction f, void* const context);
+unsigned hashmapShardedSize(HashmapSharded* const hashmap);
+int hashmapShardedStartMaintenance(HashmapSharded* const hashmap, const unsigned intervalMs, const uint64_t budgetNs);
+void hashmapShardedStopMaintenance(HashmapSharded* const hashmap);
+void hashmapShardedDestroy(HashmapSharded* const hashmap);
+void hashmapShardedDestroyWithOwnership(HashmapSharded* const hashmap, int (*iterator)(void* const, HashmapElement* const));
+
+#endif  // HASHMAP_SHARDED_H
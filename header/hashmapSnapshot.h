@@ -0,0 +1,22 @@
+/**
+ * @file hashmapSnapshot.h
+ * @brief Implements full and incremental snapshot files of a hashmap
+ *
+ * A snapshot stores the buckets and the stash of the table range by range (see
+ * HASHMAP_DIRTY_RANGE). A full snapshot has every range, a delta only the
+ * ranges that changed since the previous checkpoint, so loading a full
+ * snapshot and then its deltas in order rebuilds the latest state.
+ */
+#ifndef HASHMAP_SNAPSHOT_H
+#define HASHMAP_SNAPSHOT_H
+
+#include "hashmap.h"
+
+// returns the number of bytes of a value, which are stored as they are in memory
+typedef unsigned (*HashmapValueSizer)(const void* const value, void* const context);
+
+int hashmapSnapshotWrite(Hashmap* const hashmap, const char* const path, const bool full, HashmapValueSizer sizer, void* const context);
+int hashmapSnapshotLoad(const char* const* const paths, const unsigned count, Hashmap* const outHashmap);
+int hashmapSnapshotFreeIterator(void* const context, HashmapElement* const elem);
+
+#endif  // HASHMAP_SNAPSHOT_H
@@ -0,0 +1,20 @@
+/**
+ * @file hashmapSort.h
+ * @brief Implements a parallel dump of the keys of a hashmap in sorted order
+ */
+#ifndef HASHMAP_SORT_H
+#define HASHMAP_SORT_H
+
+#include "hashmap.h"
+
+// below this many keys a bucket of the radix sort is finished by insertion sort
+#define HASHMAP_SORT_INSERTION_THRESHOLD 32
+
+typedef struct {
+    const char* key;
+    unsigned len;
+} HashmapKeyRef;
+
+int hashmapSortedKeys(const Hashmap* const hashmap, const unsigned threads, HashmapKeyRef** const outKeys, unsigned* const outCount);
+
+#endif  // HASHMAP_SORT_H
@@ -0,0 +1,64 @@
+/**
+ * @file hashmapTrace.h
+ * @brief Implements a binary trace of the operations done on hashmaps
+ *
+ * Recording is compiled in only with HASHMAP_TRACE defined ( make TRACE=1 ),
+ * otherwise the hooks in hashmap.c compile to nothing. Once a trace is
+ * opened, every put, get, remove and expand of every hashmap of the process
+ * is appended to it, with either the key bytes or, to keep keys private, a
+ * 64 bit FNV-1a hash of them. A key given in fragments is recorded like the
+ * assembled key. The rehashing done by an expand isn't traced.
+ *
+ * Layout, in host byte order: a HashmapTraceHeader then one record per
+ * operation: a HashmapTraceRecord followed by the key bytes ( len of them )
+ * or the key hash ( 8 bytes ). Expand records carry the new table size in
+ * len and nothing after. Traces are replayed by tools/hmreplay.
+ */
+#ifndef HASHMAP_TRACE_H
+#define HASHMAP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+#define HASHMAP_TRACE_MAGIC "HMTRACE1"
+// stdio buffer of the trace file, records are written through it
+#define HASHMAP_TRACE_BUFFER (1 << 20)
+
+typedef enum {
+    HASHMAP_TRACE_PUT = 1,
+    HASHMAP_TRACE_GET,
+    HASHMAP_TRACE_REMOVE,
+    HASHMAP_TRACE_EXPAND
+} HashmapTraceOp;
+
+typedef struct {
+    char magic[8];
+    uint32_t hashedKeys;
+} HashmapTraceHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t op;
+    uint32_t map;  // identifies the hashmap within the trace
+    uint32_t len;
+} HashmapTraceRecord;
+
+#ifdef HASHMAP_TRACE
+#define HASHMAP_TRACE_OP(op, map, key, len) hashmapTraceRecord((op), (map), (key), (len))
+#define HASHMAP_TRACE_FRAGMENTS(op, map, fragments, count) hashmapTraceRecordFragments((op), (map), (fragments), (count))
+#define HASHMAP_TRACE_SUPPRESS(on) hashmapTraceSuppress(on)
+#else
+#define HASHMAP_TRACE_OP(op, map, key, len) ((void)0)
+#define HASHMAP_TRACE_FRAGMENTS(op, map, fragments, count) ((void)0)
+#define HASHMAP_TRACE_SUPPRESS(on) ((void)0)
+#endif
+
+int hashmapTraceOpen(const char* const path, const bool hashKeys);
+void hashmapTraceClose(void);
+void hashmapTraceRecord(const HashmapTraceOp op, const Hashmap* const hashmap, const char* const key, const unsigned len);
+void hashmapTraceRecordFragments(const HashmapTraceOp op, const Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count);
+void hashmapTraceSuppress(const bool on);
+uint64_t hashmapTraceKeyHash(const char* const key, const unsigned len);
+
+#endif  // HASHMAP_TRACE_H
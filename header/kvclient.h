@@ -0,0 +1,43 @@
+/**
+ * @file kvclient.h
+ * @brief Client library for the key-value server with request batching
+ *
+ * Requests are only queued in a local buffer and sent to the server in a
+ * single write by kvClientFlush (or once the buffer gets big). Responses come
+ * back in the order the requests were queued and are read one at a time with
+ * kvClientRead.
+ */
+#ifndef KVCLIENT_H
+#define KVCLIENT_H
+
+#include "kvproto.h"
+
+#define KV_CLIENT_AUTOFLUSH_BYTES (64u * 1024u)
+
+typedef struct {
+    int fd;
+    KvBuffer out;
+    KvBuffer in;
+    size_t inPos;
+    unsigned pending;
+} KvClient;
+
+typedef struct {
+    KvStatus status;
+    const char* payload;
+    uint32_t len;
+} KvResponse;
+
+int kvClientConnect(const char* const path, KvClient* const outClient);
+int kvClientQueue(KvClient* const client, const KvOp op, const char* const key, const unsigned keyLen, const char* const val, const unsigned valLen);
+int kvClientQueueGet(KvClient* const client, const char* const key, const unsigned keyLen);
+int kvClientQueuePut(KvClient* const client, const char* const key, const unsigned keyLen, const char* const val, const unsigned valLen);
+int kvClientQueueRemove(KvClient* const client, const char* const key, const unsigned keyLen);
+int kvClientQueueScan(KvClient* const client, const char* const prefix, const unsigned prefixLen);
+int kvClientQueueScanStep(KvClient* const client, const char* const prefix, const unsigned prefixLen, const uint64_t cursor);
+int kvClientQueueStats(KvClient* const client);
+int kvClientFlush(KvClient* const client);
+int kvClientRead(KvClient* const client, KvResponse* const outResponse);
+void kvClientClose(KvClient* const client);
+
+#endif  // KVCLIENT_H
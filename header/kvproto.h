@@ -0,0 +1,84 @@
+/**
+ * @file kvproto.h
+ * @brief Binary wire protocol shared by the key-value server and its client library
+ *
+ * A request is a 9 byte header (op, key length, value length) followed by the
+ * key and value bytes. A response is a 5 byte header (status, payload length)
+ * followed by the payload. A scan payload is a sequence of entries, each one
+ * a key length, a value length, the key and the value. A scan request with
+ * an 8 byte cursor as value only walks a slice of the store: its payload
+ * starts with the cursor to send next (0 once done) before the entries.
+ * Integers are sent in host byte order since both ends always live on the
+ * same machine.
+ *
+ * A KV_OP_REPLICATE request turns the connection into a replication stream.
+ * The primary then sends records, each a 8 byte sequence number followed by
+ * an encoded request: first a PUT for every key (the snapshot), then a SYNC
+ * carrying the sequence the snapshot was taken at and from then on every PUT
+ * and REMOVE it executes. The follower answers each applied batch with an ACK
+ * request holding its applied sequence as value and the primary replies with
+ * an ACK record carrying its own latest sequence.
+ */
+#ifndef KVPROTO_H
+#define KVPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KV_REQUEST_HEADER_SIZE 9
+#define KV_RESPONSE_HEADER_SIZE 5
+#define KV_RECORD_HEADER_SIZE (sizeof(uint64_t) + KV_REQUEST_HEADER_SIZE)
+#define KV_MAX_PAYLOAD (64u * 1024u * 1024u)
+#define KV_DEFAULT_SOCKET "/tmp/hashmap.sock"
+#define KV_SCAN_STEP 1024
+
+typedef enum {
+    KV_OP_GET = 1,
+    KV_OP_PUT,
+    KV_OP_REMOVE,
+    KV_OP_SCAN,
+    KV_OP_STATS,
+    KV_OP_REPLICATE,
+    KV_OP_SYNC,
+    KV_OP_ACK
+} KvOp;
+
+typedef enum {
+    KV_STATUS_OK = 0,
+    KV_STATUS_NOT_FOUND,
+    KV_STATUS_ERROR
+} KvStatus;
+
+typedef struct {
+    uint8_t op;
+    uint32_t keyLen;
+    uint32_t valLen;
+} KvRequestHeader;
+
+typedef struct {
+    uint8_t status;
+    uint32_t len;
+} KvResponseHeader;
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} KvBuffer;
+
+void kvEncodeRequestHeader(char* const out, const KvRequestHeader* const header);
+void kvDecodeRequestHeader(const char* const in, KvRequestHeader* const outHeader);
+void kvEncodeResponseHeader(char* const out, const KvResponseHeader* const header);
+void kvDecodeResponseHeader(const char* const in, KvResponseHeader* const outHeader);
+int kvAppendRecord(KvBuffer* const buffer, const uint64_t seq, const KvOp op, const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen);
+void kvDecodeRecordHeader(const char* const in, uint64_t* const outSeq, KvRequestHeader* const outHeader);
+
+int kvAppendScanEntry(KvBuffer* const buffer, const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen);
+int kvNextScanEntry(const char* const payload, const uint32_t len, uint32_t* const offset, const char** const outKey, uint32_t* const outKeyLen, const char** const outVal, uint32_t* const outValLen);
+
+int kvBufferReserve(KvBuffer* const buffer, const size_t extra);
+int kvBufferAppend(KvBuffer* const buffer, const void* const bytes, const size_t len);
+void kvBufferConsume(KvBuffer* const buffer, const size_t len);
+void kvBufferFree(KvBuffer* const buffer);
+
+#endif  // KVPROTO_H
@@ -0,0 +1,47 @@
+/**
+ * @file symbolTable.h
+ * @brief Implements the compiler symbol table entries stored in a hashmap
+ */
+#ifndef HASHMAP_SYMBOL_TABLE_H
+#define HASHMAP_SYMBOL_TABLE_H
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+
+enum dataType { INTEGER,
+                REAL };
+union v {
+    int integer;
+    float real;
+};
+
+struct _var {
+    bool isVar;
+    int type;  // 0: int, 1: n_real
+    union v value;
+    unsigned scope;
+    unsigned addr;
+    char name[32];
+};
+
+struct _proc {
+    bool isVar;
+    int returnType;  // 0: int, 1: n_real
+    unsigned addr;
+    char name[32];
+    int* argsTypes;
+    char** argsNames;
+};
+
+int compilerLogFreeIterator(void* const context, HashmapElement* const elem);
+struct _var* newVar(char name[], int type, union v value, unsigned scope);
+struct _proc* newProc(char name[], int returnType, unsigned addr);
+int insertVar(Hashmap* symbolTable, char name[], int type, union v value, unsigned scope);
+int insertProc(Hashmap* symbolTable, char name[], int returnType, unsigned addr);
+int incrementVar(void* const context, void** const value, const bool found);
+void showSymbolTableElement(void* const elem);
+const char* symbolName(const void* const symbol, unsigned* const outLen);
+const unsigned* symbolAddr(const void* const symbol);
+
+#endif  // HASHMAP_SYMBOL_TABLE_H
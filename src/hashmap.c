@@ -5,11 +5,53 @@
  * Based on https://github.com/sheredom/hashmap.h
  */
 
+#define _GNU_SOURCE
+
 #include "../header/hashmap.h"
 
+#include "../header/hashmapArena.h"
+#include "../header/hashmapHasher.h"
+#include "../header/hashmapTrace.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+/**
+ * @brief Allocates a zeroed table, mapped when big enough for a shrink to give pages back
+ *
+ * @param slots The number of elements
+ * @param outMappedBytes The size of the mapping, 0 if allocated
+ * @return HashmapElement* The table, NULL if out of memory
+ */
+static HashmapElement* hashmapAllocTable(const unsigned slots, size_t* const outMappedBytes) {
+    size_t bytes = (size_t)slots * sizeof(HashmapElement);
+    *outMappedBytes = 0;
+    if (bytes < HASHMAP_MMAP_THRESHOLD) {
+        return (HashmapElement*)calloc(slots, sizeof(HashmapElement));
+    }
+    void* table = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        return NULL;
+    }
+    *outMappedBytes = bytes;
+    return (HashmapElement*)table;
+}
+
+static void hashmapFreeTable(HashmapElement* const table, const size_t mappedBytes) {
+    if (mappedBytes) {
+        munmap(table, mappedBytes);
+    } else {
+        free(table);
+    }
+}
 
 /**
  * @brief Create a hashmap
@@ -21,13 +63,21 @@
 int hashmapCreate(const unsigned initialSize, Hashmap* const outHashmap) {
     outHashmap->tableSize = initialSize;
     outHashmap->size = 0;
+    outHashmap->stashed = 0;
+    outHashmap->dirty = NULL;
+    outHashmap->hasher = &hashmapCRC32Hasher;
+    outHashmap->tuner = NULL;
+    outHashmap->front = NULL;
+    outHashmap->arena = NULL;
+    outHashmap->lowWater = 0;
+    outHashmap->removals = 0;
 
     // check if non zero power of two
     if (initialSize == 0 || ((initialSize & (initialSize - 1)) != 0)) {
         return 1;
     }
 
-    outHashmap->data = (HashmapElement*)calloc(initialSize, sizeof(HashmapElement));
+    outHashmap->data = hashmapAllocTable(initialSize + HASHMAP_STASH_SIZE, &outHashmap->mappedBytes);
     if (!outHashmap->data) {
         return 1;
     }
@@ -35,6 +85,128 @@ int hashmapCreate(const unsigned initialSize, Hashmap* const outHashmap) {
     return 0;
 }
 
+/**
+ * @brief Stores a key and its value in a bucket found by hashmapGetBucketFrom
+ *
+ * @param hashmap The hashmap
+ * @param index The bucket
+ * @param hash The full hash of the key
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param value The value to store
+ * @param copyKey False if the key already lives in the arena
+ * @return int 0 if sucess 1 if fail, the key couldn't be copied
+ */
+static int hashmapFillBucket(Hashmap* const hashmap, const unsigned index, const unsigned hash, const char* const key, const unsigned len, void* const value, const bool copyKey) {
+    HashmapElement* elem = &hashmap->data[index];
+    if (!hashmap->arena || !copyKey) {
+        elem->key = key;
+    } else if (!elem->used) {
+        // an owned key is copied once, replacing the value keeps the copy
+        const char* copy = hashmapArenaCopy(hashmap->arena, key, len);
+        if (!copy) {
+            return 1;
+        }
+        elem->key = copy;
+    }
+    elem->data = value;
+    elem->keyLen = len;
+    elem->probeDist = (unsigned char)((index - hash) & (hashmap->tableSize - 1));
+    elem->fingerprint = hashmapFingerprint(hash);
+
+    // if key was not used yet, set to used and increase the size
+    if (!elem->used) {
+        elem->used = true;
+        hashmap->size++;
+        hashmap->stashed += index >= hashmap->tableSize;
+        if (hashmap->tuner) {
+            hashmapTuneRecord(hashmap->tuner, key, len);
+        }
+    }
+
+    if (hashmap->dirty) {
+        hashmapMarkDirty(hashmap, index);
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks for a key in the stash
+ *
+ * @param hashmap The hashmap
+ * @param fingerprint The fingerprint of the key
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param outIndex The output index
+ * @return bool If the key was found
+ */
+static bool hashmapFindStashed(const Hashmap* const hashmap, const uint16_t fingerprint, const char* const key, const unsigned len, unsigned* const outIndex) {
+    if (!hashmap->stashed) {
+        return false;
+    }
+    for (unsigned i = hashmap->tableSize; i < hashmap->tableSize + HASHMAP_STASH_SIZE; i++) {
+        if (hashmap->data[i].used && hashmapCheckIfMatch(&hashmap->data[i], fingerprint, key, len)) {
+            *outIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Looks for the bucket holding a key
+ *
+ * @param hashmap The hashmap
+ * @param hash The full hash of the key
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param outIndex The output index
+ * @return bool If the key was found
+ */
+static bool hashmapFindBucket(const Hashmap* const hashmap, const unsigned hash, const char* const key, const unsigned len, unsigned* const outIndex) {
+    uint16_t fingerprint = hashmapFingerprint(hash);
+    unsigned int curr = hash % hashmap->tableSize;
+    for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
+        if (hashmap->data[curr].used && hashmapCheckIfMatch(&hashmap->data[curr], fingerprint, key, len)) {
+            *outIndex = curr;
+            return true;
+        }
+        curr = (curr + 1) % hashmap->tableSize;
+    }
+    return hashmapFindStashed(hashmap, fingerprint, key, len, outIndex);
+}
+
+/**
+ * @brief Empties a used bucket
+ *
+ * @param hashmap The hashmap
+ * @param index The bucket
+ */
+static void hashmapClearBucket(Hashmap* const hashmap, const unsigned index) {
+    if (hashmap->arena) {
+        hashmapArenaRelease(hashmap->arena, hashmap->data[index].keyLen);
+    }
+    memset(&hashmap->data[index], 0, sizeof(HashmapElement));
+    hashmap->size--;
+    hashmap->stashed -= index >= hashmap->tableSize;
+    if (hashmap->dirty) {
+        hashmapMarkDirty(hashmap, index);
+    }
+}
+
+/**
+ * @brief Halves the table once the removes since the last resize paid for it
+ * and the load fell under the low-water mark
+ *
+ * @param hashmap The hashmap a key was just removed from
+ */
+static void hashmapShrinkIfSparse(Hashmap* const hashmap) {
+    if (hashmap->lowWater > 0 && ++hashmap->removals >= hashmap->tableSize / HASHMAP_SHRINK_REMOVALS &&
+        hashmap->size < hashmap->lowWater * hashmap->tableSize && hashmap->tableSize > HASHMAP_SHRINK_MIN_SIZE) {
+        hashmapShrink(hashmap);
+    }
+}
+
 /**
  * @brief Put an element into the hashmap
  *
@@ -45,31 +217,55 @@ int hashmapCreate(const unsigned initialSize, Hashmap* const outHashmap) {
  * @return int 0 if sucess 1 if fail
  */
 int hashmapPut(Hashmap* const hashmap, const char* const key, const unsigned len, void* const value) {
+    return hashmapPutHashed(hashmap, hashmapHash(hashmap, key, len), key, len, value);
+}
+
+/**
+ * @brief Put an element whose hash is already known into the hashmap
+ *
+ * @param hashmap The hashmap to insert into
+ * @param hash The full hash of the key, as given by hashmapHash
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param value The value to insert
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapPutHashed(Hashmap* const hashmap, unsigned hash, const char* const key, const unsigned len, void* const value) {
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_PUT, hashmap, key, len);
+
     // find a bucket to put the value
     // expand the hashmap until it can find a suitable bucket
     unsigned int outIndex;
-    while (!hashmapGetBucket(hashmap, key, len, &outIndex)) {
+    while (!hashmapGetBucketFrom(hashmap, hash, key, len, &outIndex)) {
+        const HashmapHasher* hasher = hashmap->hasher;
         if (hashmapExpand(hashmap)) {
             return 1;
         }
+        // a tuned hasher picked by the expand makes the hash stale
+        if (hashmap->hasher != hasher) {
+            hash = hashmapHash(hashmap, key, len);
+        }
     }
 
-    // put the value
-    hashmap->data[outIndex].data = value;
-    hashmap->data[outIndex].key = key;
-    hashmap->data[outIndex].keyLen = len;
-
-    // if key was not used yet, set to used and increase the size
-    if (!hashmap->data[outIndex].used) {
-        hashmap->data[outIndex].used = true;
-        hashmap->size++;
-    }
+    return hashmapFillBucket(hashmap, outIndex, hash, key, len, value, true);
+}
 
-    return 0;
+/**
+ * @brief Picks the front cache entry of a key pointer
+ *
+ * @param front The front cache
+ * @param key The key
+ * @return unsigned The index of the entry
+ */
+static unsigned hashmapFrontIndex(const HashmapFrontCache* const front, const char* const key) {
+    uint64_t p = (uint64_t)(uintptr_t)key;
+    return (unsigned)((p * 0x9E3779B97F4A7C15ULL) >> 32) & front->mask;
 }
 
 /**
- * @brief Get an element from the hashmap
+ * @brief Get an element from the hashmap.
+ * With a front cache, the call records where the key was found, so a
+ * hashmap with a front cache must not be read by several threads at once
  *
  * @param hashmap The hashmap to get from
  * @param key The string key to use
@@ -77,23 +273,68 @@ int hashmapPut(Hashmap* const hashmap, const char* const key, const unsigned len
  * @return void* The previously set element, or NULL if none exists
  */
 void* hashmapGet(const Hashmap* const hashmap, const char* const key, const unsigned len) {
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_GET, hashmap, key, len);
+
+    HashmapFrontEntry* front = NULL;
+    if (hashmap->front) {
+        // a bucket still holding this very key pointer is this key, no hashing needed
+        front = &hashmap->front->entries[hashmapFrontIndex(hashmap->front, key)];
+        if (front->key == key && front->len == len && front->slot < hashmap->tableSize + HASHMAP_STASH_SIZE) {
+            const HashmapElement* elem = &hashmap->data[front->slot];
+            if (elem->used && elem->key == key && elem->keyLen == len) {
+                return elem->data;
+            }
+        }
+    }
+
     // find a bucket
-    unsigned int curr = hashmapStringHasher(hashmap, key, len);
+    unsigned int hash = hashmapHash(hashmap, key, len);
+    uint16_t fingerprint = hashmapFingerprint(hash);
+    unsigned int curr = hash % hashmap->tableSize;
 
     // linear probing, if necessary
     for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
         if (hashmap->data[curr].used) {
-            if (hashmapCheckIfMatch(&hashmap->data[curr], key, len)) {
+            if (hashmapCheckIfMatch(&hashmap->data[curr], fingerprint, key, len)) {
+                if (front) {
+                    front->key = key;
+                    front->len = len;
+                    front->slot = curr;
+                }
                 return hashmap->data[curr].data;
             }
         }
         curr = (curr + 1) % hashmap->tableSize;
     }
 
+    if (hashmapFindStashed(hashmap, fingerprint, key, len, &curr)) {
+        if (front) {
+            front->key = key;
+            front->len = len;
+            front->slot = curr;
+        }
+        return hashmap->data[curr].data;
+    }
+
     // not found
     return NULL;
 }
 
+/**
+ * @brief Get an element whose hash is already known from the hashmap, bypassing the front cache
+ *
+ * @param hashmap The hashmap to get from
+ * @param hash The full hash of the key, as given by hashmapHash
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return void* The previously set element, or NULL if none exists
+ */
+void* hashmapGetHashed(const Hashmap* const hashmap, const unsigned hash, const char* const key, const unsigned len) {
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_GET, hashmap, key, len);
+    unsigned int index;
+    return hashmapFindBucket(hashmap, hash, key, len, &index) ? hashmap->data[index].data : NULL;
+}
+
 /**
  * @brief Removes a key from the hashmap
  *
@@ -103,110 +344,175 @@ void* hashmapGet(const Hashmap* const hashmap, const char* const key, const unsi
  * @return int 0, if it found and removed it 1 otherwise
  */
 int hashmapRemove(Hashmap* const hashmap, const char* const key, const unsigned len) {
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_REMOVE, hashmap, key, len);
+
     // find a bucket
-    unsigned int curr = hashmapStringHasher(hashmap, key, len);
+    unsigned int hash = hashmapHash(hashmap, key, len);
+    uint16_t fingerprint = hashmapFingerprint(hash);
+    unsigned int curr = hash % hashmap->tableSize;
 
     // Linear probing, if necessary
     for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
         if (hashmap->data[curr].used) {
-            if (hashmapCheckIfMatch(&hashmap->data[curr], key, len)) {
+            if (hashmapCheckIfMatch(&hashmap->data[curr], fingerprint, key, len)) {
                 // Blank out everything
-                memset(&hashmap->data[curr], 0, sizeof(HashmapElement));
-                hashmap->size--;
+                hashmapClearBucket(hashmap, curr);
+                hashmapShrinkIfSparse(hashmap);
                 return 0;
             }
         }
         curr = (curr + 1) % hashmap->tableSize;
     }
 
+    if (hashmapFindStashed(hashmap, fingerprint, key, len, &curr)) {
+        hashmapClearBucket(hashmap, curr);
+        hashmapShrinkIfSparse(hashmap);
+        return 0;
+    }
     return 1;
 }
 
+/**
+ * @brief Reads, changes, inserts or removes the value of a key with a single probe.
+ * f gets the current value in *value, NULL if the key is absent.
+ * If f returns -1, remove the key.
+ * If f returns 0, store *value, inserting the key if absent.
+ * otherwise leave the hashmap untouched
+ *
+ * @param hashmap The hashmap
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param f The function pointer deciding the new value
+ * @param context The context to pass as the first argument to f
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapCompute(Hashmap* const hashmap, const char* const key, const unsigned len, HashmapComputeFunction f, void* const context) {
+    // the same probe as put, so the bucket is either the key or where it goes
+    unsigned int outIndex;
+    unsigned int hash = hashmapHash(hashmap, key, len);
+    bool hasBucket = hashmapGetBucketFrom(hashmap, hash, key, len, &outIndex);
+    bool found = hasBucket ? hashmap->data[outIndex].used : hashmapFindBucket(hashmap, hash, key, len, &outIndex);
+
+    void* value = found ? hashmap->data[outIndex].data : NULL;
+    switch (f(context, &value, found)) {
+        case -1:  // remove
+            HASHMAP_TRACE_OP(HASHMAP_TRACE_REMOVE, hashmap, key, len);
+            if (found) {
+                hashmapClearBucket(hashmap, outIndex);
+                hashmapShrinkIfSparse(hashmap);
+            }
+            return 0;
+        case 0:  // store
+            break;
+        default:  // leave as is
+            HASHMAP_TRACE_OP(HASHMAP_TRACE_GET, hashmap, key, len);
+            return 0;
+    }
+
+    // no room left for a new key, put expands first
+    if (!hasBucket && !found) {
+        return hashmapPut(hashmap, key, len, value);
+    }
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_PUT, hashmap, key, len);
+    return hashmapFillBucket(hashmap, outIndex, hash, key, len, value, true);
+}
+
 /**
  * @brief Destroy the hashmap
  *
  * @param hashmap The hashmap to destroy
  */
 void hashmapDestroy(Hashmap* const hashmap) {
-    free(hashmap->data);
+    if (hashmap->data) {
+        hashmapFreeTable(hashmap->data, hashmap->mappedBytes);
+    }
+    free(hashmap->dirty);
+    hashmapTunerFree(hashmap->tuner);
+    free(hashmap->front);
+    hashmapArenaFree(hashmap->arena);
     memset(hashmap, 0, sizeof(Hashmap));
 }
 
 /**
- * @brief Check if the keys for two elements are the same. Used to detect collisions
+ * @brief Check if the keys for two elements are the same. Used to detect collisions.
+ * Most other keys are rejected by their fingerprint, without touching the key
  *
  * @param element The element to be checked against
+ * @param fingerprint The fingerprint of the key to check for
  * @param key The key to check for
  * @param len The length of the key to check for
  * @return int If the keys are the same
  */
-bool hashmapCheckIfMatch(const HashmapElement* const element, const char* const key, const unsigned len) {
-    return (element->keyLen == len) && (memcmp(element->key, key, len) == 0);
+bool hashmapCheckIfMatch(const HashmapElement* const element, const uint16_t fingerprint, const char* const key, const unsigned len) {
+    return (element->fingerprint == fingerprint) && (element->keyLen == len) && (memcmp(element->key, key, len) == 0);
 }
 
+// CRC32C ( Castagnoli ) table, reflected
+static const unsigned crc32tab[] = {
+    0x00000000U, 0xF26B8303U, 0xE13B70F7U, 0x1350F3F4U, 0xC79A971FU,
+    0x35F1141CU, 0x26A1E7E8U, 0xD4CA64EBU, 0x8AD958CFU, 0x78B2DBCCU,
+    0x6BE22838U, 0x9989AB3BU, 0x4D43CFD0U, 0xBF284CD3U, 0xAC78BF27U,
+    0x5E133C24U, 0x105EC76FU, 0xE235446CU, 0xF165B798U, 0x030E349BU,
+    0xD7C45070U, 0x25AFD373U, 0x36FF2087U, 0xC494A384U, 0x9A879FA0U,
+    0x68EC1CA3U, 0x7BBCEF57U, 0x89D76C54U, 0x5D1D08BFU, 0xAF768BBCU,
+    0xBC267848U, 0x4E4DFB4BU, 0x20BD8EDEU, 0xD2D60DDDU, 0xC186FE29U,
+    0x33ED7D2AU, 0xE72719C1U, 0x154C9AC2U, 0x061C6936U, 0xF477EA35U,
+    0xAA64D611U, 0x580F5512U, 0x4B5FA6E6U, 0xB93425E5U, 0x6DFE410EU,
+    0x9F95C20DU, 0x8CC531F9U, 0x7EAEB2FAU, 0x30E349B1U, 0xC288CAB2U,
+    0xD1D83946U, 0x23B3BA45U, 0xF779DEAEU, 0x05125DADU, 0x1642AE59U,
+    0xE4292D5AU, 0xBA3A117EU, 0x4851927DU, 0x5B016189U, 0xA96AE28AU,
+    0x7DA08661U, 0x8FCB0562U, 0x9C9BF696U, 0x6EF07595U, 0x417B1DBCU,
+    0xB3109EBFU, 0xA0406D4BU, 0x522BEE48U, 0x86E18AA3U, 0x748A09A0U,
+    0x67DAFA54U, 0x95B17957U, 0xCBA24573U, 0x39C9C670U, 0x2A993584U,
+    0xD8F2B687U, 0x0C38D26CU, 0xFE53516FU, 0xED03A29BU, 0x1F682198U,
+    0x5125DAD3U, 0xA34E59D0U, 0xB01EAA24U, 0x42752927U, 0x96BF4DCCU,
+    0x64D4CECFU, 0x77843D3BU, 0x85EFBE38U, 0xDBFC821CU, 0x2997011FU,
+    0x3AC7F2EBU, 0xC8AC71E8U, 0x1C661503U, 0xEE0D9600U, 0xFD5D65F4U,
+    0x0F36E6F7U, 0x61C69362U, 0x93AD1061U, 0x80FDE395U, 0x72966096U,
+    0xA65C047DU, 0x5437877EU, 0x4767748AU, 0xB50CF789U, 0xEB1FCBADU,
+    0x197448AEU, 0x0A24BB5AU, 0xF84F3859U, 0x2C855CB2U, 0xDEEEDFB1U,
+    0xCDBE2C45U, 0x3FD5AF46U, 0x7198540DU, 0x83F3D70EU, 0x90A324FAU,
+    0x62C8A7F9U, 0xB602C312U, 0x44694011U, 0x5739B3E5U, 0xA55230E6U,
+    0xFB410CC2U, 0x092A8FC1U, 0x1A7A7C35U, 0xE811FF36U, 0x3CDB9BDDU,
+    0xCEB018DEU, 0xDDE0EB2AU, 0x2F8B6829U, 0x82F63B78U, 0x709DB87BU,
+    0x63CD4B8FU, 0x91A6C88CU, 0x456CAC67U, 0xB7072F64U, 0xA457DC90U,
+    0x563C5F93U, 0x082F63B7U, 0xFA44E0B4U, 0xE9141340U, 0x1B7F9043U,
+    0xCFB5F4A8U, 0x3DDE77ABU, 0x2E8E845FU, 0xDCE5075CU, 0x92A8FC17U,
+    0x60C37F14U, 0x73938CE0U, 0x81F80FE3U, 0x55326B08U, 0xA759E80BU,
+    0xB4091BFFU, 0x466298FCU, 0x1871A4D8U, 0xEA1A27DBU, 0xF94AD42FU,
+    0x0B21572CU, 0xDFEB33C7U, 0x2D80B0C4U, 0x3ED04330U, 0xCCBBC033U,
+    0xA24BB5A6U, 0x502036A5U, 0x4370C551U, 0xB11B4652U, 0x65D122B9U,
+    0x97BAA1BAU, 0x84EA524EU, 0x7681D14DU, 0x2892ED69U, 0xDAF96E6AU,
+    0xC9A99D9EU, 0x3BC21E9DU, 0xEF087A76U, 0x1D63F975U, 0x0E330A81U,
+    0xFC588982U, 0xB21572C9U, 0x407EF1CAU, 0x532E023EU, 0xA145813DU,
+    0x758FE5D6U, 0x87E466D5U, 0x94B49521U, 0x66DF1622U, 0x38CC2A06U,
+    0xCAA7A905U, 0xD9F75AF1U, 0x2B9CD9F2U, 0xFF56BD19U, 0x0D3D3E1AU,
+    0x1E6DCDEEU, 0xEC064EEDU, 0xC38D26C4U, 0x31E6A5C7U, 0x22B65633U,
+    0xD0DDD530U, 0x0417B1DBU, 0xF67C32D8U, 0xE52CC12CU, 0x1747422FU,
+    0x49547E0BU, 0xBB3FFD08U, 0xA86F0EFCU, 0x5A048DFFU, 0x8ECEE914U,
+    0x7CA56A17U, 0x6FF599E3U, 0x9D9E1AE0U, 0xD3D3E1ABU, 0x21B862A8U,
+    0x32E8915CU, 0xC083125FU, 0x144976B4U, 0xE622F5B7U, 0xF5720643U,
+    0x07198540U, 0x590AB964U, 0xAB613A67U, 0xB831C993U, 0x4A5A4A90U,
+    0x9E902E7BU, 0x6CFBAD78U, 0x7FAB5E8CU, 0x8DC0DD8FU, 0xE330A81AU,
+    0x115B2B19U, 0x020BD8EDU, 0xF0605BEEU, 0x24AA3F05U, 0xD6C1BC06U,
+    0xC5914FF2U, 0x37FACCF1U, 0x69E9F0D5U, 0x9B8273D6U, 0x88D28022U,
+    0x7AB90321U, 0xAE7367CAU, 0x5C18E4C9U, 0x4F48173DU, 0xBD23943EU,
+    0xF36E6F75U, 0x0105EC76U, 0x12551F82U, 0xE03E9C81U, 0x34F4F86AU,
+    0xC69F7B69U, 0xD5CF889DU, 0x27A40B9EU, 0x79B737BAU, 0x8BDCB4B9U,
+    0x988C474DU, 0x6AE7C44EU, 0xBE2DA0A5U, 0x4C4623A6U, 0x5F16D052U,
+    0xAD7D5351U};
+
 /**
- * @brief Calculates the CRC32 for a string
+ * @brief Continues a CRC32 with more bytes
  *
+ * @param crc The CRC32 of the bytes before s, 0 to start
  * @param s The string
  * @param len The length of the string
- * @return unsigned The CRC32 value for the string
+ * @return unsigned The CRC32 value of the bytes before s followed by s
  */
-unsigned hashmapCRC32(const char* const s, const unsigned len) {
-    static const unsigned crc32tab[] = {
-        0x00000000U, 0xF26B8303U, 0xE13B70F7U, 0x1350F3F4U, 0xC79A971FU,
-        0x35F1141CU, 0x26A1E7E8U, 0xD4CA64EBU, 0x8AD958CFU, 0x78B2DBCCU,
-        0x6BE22838U, 0x9989AB3BU, 0x4D43CFD0U, 0xBF284CD3U, 0xAC78BF27U,
-        0x5E133C24U, 0x105EC76FU, 0xE235446CU, 0xF165B798U, 0x030E349BU,
-        0xD7C45070U, 0x25AFD373U, 0x36FF2087U, 0xC494A384U, 0x9A879FA0U,
-        0x68EC1CA3U, 0x7BBCEF57U, 0x89D76C54U, 0x5D1D08BFU, 0xAF768BBCU,
-        0xBC267848U, 0x4E4DFB4BU, 0x20BD8EDEU, 0xD2D60DDDU, 0xC186FE29U,
-        0x33ED7D2AU, 0xE72719C1U, 0x154C9AC2U, 0x061C6936U, 0xF477EA35U,
-        0xAA64D611U, 0x580F5512U, 0x4B5FA6E6U, 0xB93425E5U, 0x6DFE410EU,
-        0x9F95C20DU, 0x8CC531F9U, 0x7EAEB2FAU, 0x30E349B1U, 0xC288CAB2U,
-        0xD1D83946U, 0x23B3BA45U, 0xF779DEAEU, 0x05125DADU, 0x1642AE59U,
-        0xE4292D5AU, 0xBA3A117EU, 0x4851927DU, 0x5B016189U, 0xA96AE28AU,
-        0x7DA08661U, 0x8FCB0562U, 0x9C9BF696U, 0x6EF07595U, 0x417B1DBCU,
-        0xB3109EBFU, 0xA0406D4BU, 0x522BEE48U, 0x86E18AA3U, 0x748A09A0U,
-        0x67DAFA54U, 0x95B17957U, 0xCBA24573U, 0x39C9C670U, 0x2A993584U,
-        0xD8F2B687U, 0x0C38D26CU, 0xFE53516FU, 0xED03A29BU, 0x1F682198U,
-        0x5125DAD3U, 0xA34E59D0U, 0xB01EAA24U, 0x42752927U, 0x96BF4DCCU,
-        0x64D4CECFU, 0x77843D3BU, 0x85EFBE38U, 0xDBFC821CU, 0x2997011FU,
-        0x3AC7F2EBU, 0xC8AC71E8U, 0x1C661503U, 0xEE0D9600U, 0xFD5D65F4U,
-        0x0F36E6F7U, 0x61C69362U, 0x93AD1061U, 0x80FDE395U, 0x72966096U,
-        0xA65C047DU, 0x5437877EU, 0x4767748AU, 0xB50CF789U, 0xEB1FCBADU,
-        0x197448AEU, 0x0A24BB5AU, 0xF84F3859U, 0x2C855CB2U, 0xDEEEDFB1U,
-        0xCDBE2C45U, 0x3FD5AF46U, 0x7198540DU, 0x83F3D70EU, 0x90A324FAU,
-        0x62C8A7F9U, 0xB602C312U, 0x44694011U, 0x5739B3E5U, 0xA55230E6U,
-        0xFB410CC2U, 0x092A8FC1U, 0x1A7A7C35U, 0xE811FF36U, 0x3CDB9BDDU,
-        0xCEB018DEU, 0xDDE0EB2AU, 0x2F8B6829U, 0x82F63B78U, 0x709DB87BU,
-        0x63CD4B8FU, 0x91A6C88CU, 0x456CAC67U, 0xB7072F64U, 0xA457DC90U,
-        0x563C5F93U, 0x082F63B7U, 0xFA44E0B4U, 0xE9141340U, 0x1B7F9043U,
-        0xCFB5F4A8U, 0x3DDE77ABU, 0x2E8E845FU, 0xDCE5075CU, 0x92A8FC17U,
-        0x60C37F14U, 0x73938CE0U, 0x81F80FE3U, 0x55326B08U, 0xA759E80BU,
-        0xB4091BFFU, 0x466298FCU, 0x1871A4D8U, 0xEA1A27DBU, 0xF94AD42FU,
-        0x0B21572CU, 0xDFEB33C7U, 0x2D80B0C4U, 0x3ED04330U, 0xCCBBC033U,
-        0xA24BB5A6U, 0x502036A5U, 0x4370C551U, 0xB11B4652U, 0x65D122B9U,
-        0x97BAA1BAU, 0x84EA524EU, 0x7681D14DU, 0x2892ED69U, 0xDAF96E6AU,
-        0xC9A99D9EU, 0x3BC21E9DU, 0xEF087A76U, 0x1D63F975U, 0x0E330A81U,
-        0xFC588982U, 0xB21572C9U, 0x407EF1CAU, 0x532E023EU, 0xA145813DU,
-        0x758FE5D6U, 0x87E466D5U, 0x94B49521U, 0x66DF1622U, 0x38CC2A06U,
-        0xCAA7A905U, 0xD9F75AF1U, 0x2B9CD9F2U, 0xFF56BD19U, 0x0D3D3E1AU,
-        0x1E6DCDEEU, 0xEC064EEDU, 0xC38D26C4U, 0x31E6A5C7U, 0x22B65633U,
-        0xD0DDD530U, 0x0417B1DBU, 0xF67C32D8U, 0xE52CC12CU, 0x1747422FU,
-        0x49547E0BU, 0xBB3FFD08U, 0xA86F0EFCU, 0x5A048DFFU, 0x8ECEE914U,
-        0x7CA56A17U, 0x6FF599E3U, 0x9D9E1AE0U, 0xD3D3E1ABU, 0x21B862A8U,
-        0x32E8915CU, 0xC083125FU, 0x144976B4U, 0xE622F5B7U, 0xF5720643U,
-        0x07198540U, 0x590AB964U, 0xAB613A67U, 0xB831C993U, 0x4A5A4A90U,
-        0x9E902E7BU, 0x6CFBAD78U, 0x7FAB5E8CU, 0x8DC0DD8FU, 0xE330A81AU,
-        0x115B2B19U, 0x020BD8EDU, 0xF0605BEEU, 0x24AA3F05U, 0xD6C1BC06U,
-        0xC5914FF2U, 0x37FACCF1U, 0x69E9F0D5U, 0x9B8273D6U, 0x88D28022U,
-        0x7AB90321U, 0xAE7367CAU, 0x5C18E4C9U, 0x4F48173DU, 0xBD23943EU,
-        0xF36E6F75U, 0x0105EC76U, 0x12551F82U, 0xE03E9C81U, 0x34F4F86AU,
-        0xC69F7B69U, 0xD5CF889DU, 0x27A40B9EU, 0x79B737BAU, 0x8BDCB4B9U,
-        0x988C474DU, 0x6AE7C44EU, 0xBE2DA0A5U, 0x4C4623A6U, 0x5F16D052U,
-        0xAD7D5351U};
-
-    unsigned crc32val = 0;
+unsigned hashmapCRC32Update(const unsigned crc, const char* const s, const unsigned len) {
+
+    unsigned crc32val = crc;
     for (unsigned i = 0; i < len; i++)
         crc32val = crc32tab[(unsigned char)crc32val ^ (unsigned char)s[i]] ^ (crc32val >> 8);
 
@@ -214,16 +520,104 @@ unsigned hashmapCRC32(const char* const s, const unsigned len) {
 }
 
 /**
- * @brief Returns a hash value for a string
+ * @brief Calculates the CRC32 for a string
  *
- * @param hashmap The hashmap for which the hash is being generated
- * @param keystring The key string
- * @param len The length of the key string
- * @return unsigned the generated hash value
+ * @param s The string
+ * @param len The length of the string
+ * @return unsigned The CRC32 value for the string
  */
-unsigned hashmapStringHasher(const Hashmap* const hashmap, const char* const keystring, const unsigned len) {
-    unsigned key = hashmapCRC32(keystring, len);
+unsigned hashmapCRC32(const char* const s, const unsigned len) {
+    return hashmapCRC32Update(0, s, len);
+}
+
+#ifdef __SSE4_2__
+static uint64_t hashmapLoad64(const char* const s) {
+    uint64_t v;
+    memcpy(&v, s, sizeof(v));
+    return v;
+}
+#endif
+
+/**
+ * @brief Finishes the CRC32 of one key of a batch, from the given offset
+ *
+ * @param crc The CRC32 of the bytes before offset
+ * @param s The key
+ * @param offset The first byte left
+ * @param len The length of the key
+ * @return unsigned The CRC32 of the key
+ */
+static unsigned hashmapCRC32Tail(unsigned crc, const char* const s, unsigned offset, const unsigned len) {
+#ifdef __SSE4_2__
+    uint64_t wide = crc;
+    for (; offset + 8 <= len; offset += 8) {
+        wide = _mm_crc32_u64(wide, hashmapLoad64(s + offset));
+    }
+    crc = (unsigned)wide;
+    for (; offset < len; offset++) {
+        crc = _mm_crc32_u8(crc, (unsigned char)s[offset]);
+    }
+    return crc;
+#else
+    return hashmapCRC32Update(crc, s + offset, len - offset);
+#endif
+}
+
+/**
+ * @brief Calculates the CRC32 of several strings at once, same values as hashmapCRC32.
+ * HASHMAP_BATCH_LANES strings are hashed together, one independent chain
+ * each, so their steps overlap instead of waiting on each other. The lanes
+ * walk the length they all share in lockstep, then every one finishes alone:
+ * masking the lanes that ended measured slower than these short tails
+ *
+ * @param keys The strings
+ * @param lens The lengths of the strings
+ * @param count The number of strings
+ * @param outCrcs The storage for the count CRC32 values
+ */
+void hashmapCRC32Batch(const char* const* const keys, const unsigned* const lens, const unsigned count, unsigned* const outCrcs) {
+    unsigned first = 0;
+    for (; first + HASHMAP_BATCH_LANES <= count; first += HASHMAP_BATCH_LANES) {
+        const char* const* s = keys + first;
+        unsigned common = lens[first];
+        for (unsigned l = 1; l < HASHMAP_BATCH_LANES; l++) {
+            common = lens[first + l] < common ? lens[first + l] : common;
+        }
+
+        unsigned offset = 0;
+#ifdef __SSE4_2__
+        uint64_t crc[HASHMAP_BATCH_LANES] = {0};
+        for (; offset + 8 <= common; offset += 8) {
+            for (unsigned l = 0; l < HASHMAP_BATCH_LANES; l++) {
+                crc[l] = _mm_crc32_u64(crc[l], hashmapLoad64(s[l] + offset));
+            }
+        }
+#else
+        unsigned crc[HASHMAP_BATCH_LANES] = {0};
+        for (; offset < common; offset++) {
+            for (unsigned l = 0; l < HASHMAP_BATCH_LANES; l++) {
+                crc[l] = crc32tab[(unsigned char)crc[l] ^ (unsigned char)s[l][offset]] ^ (crc[l] >> 8);
+            }
+        }
+#endif
+
+        for (unsigned l = 0; l < HASHMAP_BATCH_LANES; l++) {
+            outCrcs[first + l] = hashmapCRC32Tail((unsigned)crc[l], s[l], offset, lens[first + l]);
+        }
+    }
+
+    for (; first < count; first++) {
+        outCrcs[first] = hashmapCRC32Tail(0, keys[first], 0, lens[first]);
+    }
+}
 
+/**
+ * @brief Spreads the bits of a raw hash, so any of its bits can pick a bucket
+ *
+ * @param key The raw hash
+ * @return unsigned The mixed hash
+ */
+static unsigned hashmapMix(unsigned key) {
     // Robert Jenkins' 32 bit Mix Function
     key += (key << 12);
     key ^= (key >> 22);
@@ -236,7 +630,65 @@ unsigned hashmapStringHasher(const Hashmap* const hashmap, const char* const key
 
     // Knuth's Multiplicative Method
     key = (key >> 3) * 2654435761;
-    return key % hashmap->tableSize;
+    return key;
+}
+
+/**
+ * @brief Returns the full hash of a string, before reducing it to a bucket
+ *
+ * @param hashmap The hashmap for which the hash is being generated
+ * @param keystring The key string
+ * @param len The length of the key string
+ * @return unsigned the generated hash value
+ */
+unsigned hashmapHash(const Hashmap* const hashmap, const char* const keystring, const unsigned len) {
+    return hashmapMix(hashmap->hasher->update(hashmap->hasher->seed, keystring, len));
+}
+
+/**
+ * @brief Returns the full hashes of several strings, same values as hashmapHash
+ *
+ * @param hashmap The hashmap for which the hashes are being generated
+ * @param keys The key strings
+ * @param lens The lengths of the key strings
+ * @param count The number of keys
+ * @param outHashes The storage for the count hashes
+ */
+void hashmapHashBatch(const Hashmap* const hashmap, const char* const* const keys, const unsigned* const lens, const unsigned count, unsigned* const outHashes) {
+    if (hashmap->hasher == &hashmapCRC32Hasher) {
+        hashmapCRC32Batch(keys, lens, count, outHashes);
+    } else {
+        for (unsigned i = 0; i < count; i++) {
+            outHashes[i] = hashmap->hasher->update(hashmap->hasher->seed, keys[i], lens[i]);
+        }
+    }
+    for (unsigned i = 0; i < count; i++) {
+        outHashes[i] = hashmapMix(outHashes[i]);
+    }
+}
+
+/**
+ * @brief Derives the fingerprint stored next to a key from its full hash.
+ * The bucket only uses the low bits, so the bits are mixed again to make
+ * keys of the same probe window differ in their fingerprint too
+ *
+ * @param hash The full hash, as given by hashmapHash
+ * @return uint16_t The fingerprint
+ */
+uint16_t hashmapFingerprint(const unsigned hash) {
+    return (uint16_t)((hash * 0x9E3779B1U) >> 16);
+}
+
+/**
+ * @brief Returns a hash value for a string
+ *
+ * @param hashmap The hashmap for which the hash is being generated
+ * @param keystring The key string
+ * @param len The length of the key string
+ * @return unsigned the generated hash value
+ */
+unsigned hashmapStringHasher(const Hashmap* const hashmap, const char* const keystring, const unsigned len) {
+    return hashmapHash(hashmap, keystring, len) % hashmap->tableSize;
 }
 
 /**
@@ -249,49 +701,316 @@ unsigned hashmapStringHasher(const Hashmap* const hashmap, const char* const key
  * @return bool If a bucket was found
  */
 bool hashmapGetBucket(const Hashmap* const hashmap, const char* const key, const unsigned len, unsigned* const outIndex) {
+    return hashmapGetBucketFrom(hashmap, hashmapHash(hashmap, key, len), key, len, outIndex);
+}
+
+/**
+ * @brief Gets an empty bucket for a key known not to be in the hashmap
+ *
+ * @param hashmap The hashmap
+ * @param start The home bucket of the key
+ * @param probe False if the probe window is known to be full
+ * @param outIndex The output index
+ * @return bool If a bucket was found
+ */
+static bool hashmapFreeBucket(const Hashmap* const hashmap, const unsigned start, const bool probe, unsigned* const outIndex) {
+    // return the first not used bucket
+    if (probe) {
+        unsigned int curr = start;
+        for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
+            if (!hashmap->data[curr].used) {
+                *outIndex = curr;
+                return true;
+            }
+
+            curr = (curr + 1) % hashmap->tableSize;
+        }
+    }
+
+    // could not find empty bucket within HASHMAP_MAX_CHAIN_LENGTH, an unlucky
+    // cluster in a mostly empty table goes to the stash instead of doubling it
+    if (hashmap->stashed < HASHMAP_STASH_SIZE && hashmap->size < HASHMAP_STASH_MAX_LOAD * hashmap->tableSize) {
+        for (unsigned i = hashmap->tableSize; i < hashmap->tableSize + HASHMAP_STASH_SIZE; i++) {
+            if (!hashmap->data[i].used) {
+                *outIndex = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Gets a bucket index for an element whose hash is already known
+ *
+ * @param hashmap The hashmap to look for the bucket
+ * @param hash The full hash of the key, as given by hashmapHash
+ * @param key The key to insert
+ * @param len The length of the key to insert
+ * @param outIndex The output index
+ * @return bool If a bucket was found
+ */
+bool hashmapGetBucketFrom(const Hashmap* const hashmap, const unsigned hash, const char* const key, const unsigned len, unsigned* const outIndex) {
     /* If full, return immediately */
     if (hashmap->size >= hashmap->tableSize) {
         return false;
     }
 
-    // find original index
-    unsigned int start = hashmapStringHasher(hashmap, key, len);
-
     // linear probe to check if we've already insert the element
+    const unsigned start = hash % hashmap->tableSize;
+    const uint16_t fingerprint = hashmapFingerprint(hash);
     int totalUsed = 0;
     unsigned int curr = start;
     for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
         bool used = hashmap->data[curr].used;
         totalUsed += used;
-        if (used && hashmapCheckIfMatch(&hashmap->data[curr], key, len)) {
+        if (used && hashmapCheckIfMatch(&hashmap->data[curr], fingerprint, key, len)) {
             *outIndex = curr;
             return true;
         }
         curr = (curr + 1) % hashmap->tableSize;
     }
 
-    // linear probe again (if there was at least one empty entry),
-    // this time knowing the element isn't there.
-    // return the first not used bucket
-    if (HASHMAP_MAX_CHAIN_LENGTH > totalUsed) {
-        curr = start;
-        for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
-            if (!hashmap->data[curr].used) {
-                *outIndex = curr;
-                return true;
-            }
-
-            curr = (curr + 1) % hashmap->tableSize;
-        }
+    // a key stashed while its window was full stays there
+    if (hashmapFindStashed(hashmap, fingerprint, key, len, outIndex)) {
+        return true;
     }
 
-    // could not find empty bucket within HASHMAP_MAX_CHAIN_LENGTH
-    return false;
+    // linear probe again (if there was at least one empty entry),
+    // this time knowing the element isn't there.
+    return hashmapFreeBucket(hashmap, start, HASHMAP_MAX_CHAIN_LENGTH > totalUsed, outIndex);
 }
 
 /**
- * @brief Iterate over all the elements in a hashmap applying the function f.
- * If f returns -1, remove the item.
+ * @brief Starts hashing a key fed in pieces, for keys that arrive split
+ * across buffers. The final hash is only valid for the hashmap until it
+ * changes its hasher ( see hashmapAutoTune )
+ *
+ * @param hashmap The hashmap the key will be looked up in
+ * @param state The hash state to start
+ */
+void hashmapHashInit(const Hashmap* const hashmap, HashmapHashState* const state) {
+    state->hasher = hashmap->hasher;
+    state->state = hashmap->hasher->seed;
+    state->len = 0;
+}
+
+/**
+ * @brief Feeds the next piece of a key to a hash state
+ *
+ * @param state The hash state
+ * @param s The piece of the key
+ * @param len The length of the piece
+ */
+void hashmapHashUpdate(HashmapHashState* const state, const char* const s, const unsigned len) {
+    state->state = state->hasher->update(state->state, s, len);
+    state->len += len;
+}
+
+/**
+ * @brief Finishes a hash state
+ *
+ * @param state The hash state
+ * @return unsigned The hash of the pieces fed so far, same value as hashmapHash on their concatenation
+ */
+unsigned hashmapHashFinal(const HashmapHashState* const state) {
+    return hashmapMix(state->state);
+}
+
+/**
+ * @brief Hashes a key given in fragments
+ *
+ * @param hashmap The hashmap for which the hash is being generated
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @return unsigned The hash of the key, same value as hashmapHash on the concatenation
+ */
+static unsigned hashmapHashFragments(const Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count) {
+    HashmapHashState state;
+    hashmapHashInit(hashmap, &state);
+    for (unsigned i = 0; i < count; i++) {
+        hashmapHashUpdate(&state, fragments[i].bytes, fragments[i].len);
+    }
+    return hashmapHashFinal(&state);
+}
+
+static unsigned hashmapFragmentsLength(const HashmapKeyFragment* const fragments, const unsigned count) {
+    unsigned len = 0;
+    for (unsigned i = 0; i < count; i++) {
+        len += fragments[i].len;
+    }
+    return len;
+}
+
+/**
+ * @brief Checks if an element holds a key given in fragments, comparing piece by piece
+ *
+ * @param element The element to be checked against
+ * @param fingerprint The fingerprint of the key to check for
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @param len The length of the key
+ * @return bool If the keys are the same
+ */
+static bool hashmapFragmentsMatch(const HashmapElement* const element, const uint16_t fingerprint, const HashmapKeyFragment* const fragments, const unsigned count, const unsigned len) {
+    if (element->fingerprint != fingerprint || element->keyLen != len) {
+        return false;
+    }
+    const char* key = element->key;
+    for (unsigned i = 0; i < count; i++) {
+        if (memcmp(key, fragments[i].bytes, fragments[i].len) != 0) {
+            return false;
+        }
+        key += fragments[i].len;
+    }
+    return true;
+}
+
+/**
+ * @brief Looks for the bucket holding a key given in fragments
+ *
+ * @param hashmap The hashmap
+ * @param hash The full hash of the key
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @param len The length of the key
+ * @param outIndex The output index
+ * @return bool If the key was found
+ */
+static bool hashmapFindFragments(const Hashmap* const hashmap, const unsigned hash, const HashmapKeyFragment* const fragments, const unsigned count, const unsigned len, unsigned* const outIndex) {
+    uint16_t fingerprint = hashmapFingerprint(hash);
+    unsigned int curr = hash % hashmap->tableSize;
+    for (unsigned int i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
+        if (hashmap->data[curr].used && hashmapFragmentsMatch(&hashmap->data[curr], fingerprint, fragments, count, len)) {
+            *outIndex = curr;
+            return true;
+        }
+        curr = (curr + 1) % hashmap->tableSize;
+    }
+    if (hashmap->stashed) {
+        for (unsigned i = hashmap->tableSize; i < hashmap->tableSize + HASHMAP_STASH_SIZE; i++) {
+            if (hashmap->data[i].used && hashmapFragmentsMatch(&hashmap->data[i], fingerprint, fragments, count, len)) {
+                *outIndex = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Put an element whose key is the concatenation of several fragments.
+ * A new key of more than one fragment is stored contiguous in the key arena,
+ * so the hashmap must own its keys ( see hashmapOwnKeys ) to take one
+ *
+ * @param hashmap The hashmap to insert into
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @param value The value to insert
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapPutFragments(Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count, void* const value) {
+    return hashmapPutHashedFragments(hashmap, hashmapHashFragments(hashmap, fragments, count), fragments, count, value);
+}
+
+/**
+ * @brief Put an element whose key, given in fragments, was already hashed, see hashmapPutFragments
+ *
+ * @param hashmap The hashmap to insert into
+ * @param hash The full hash of the key, as given by hashmapHashFinal
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @param value The value to insert
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapPutHashedFragments(Hashmap* const hashmap, unsigned hash, const HashmapKeyFragment* const fragments, const unsigned count, void* const value) {
+    const unsigned len = hashmapFragmentsLength(fragments, count);
+    if (count <= 1) {
+        return hashmapPutHashed(hashmap, hash, count ? fragments[0].bytes : "", len, value);
+    }
+    HASHMAP_TRACE_FRAGMENTS(HASHMAP_TRACE_PUT, hashmap, fragments, count);
+
+    unsigned int outIndex;
+    if (hashmapFindFragments(hashmap, hash, fragments, count, len, &outIndex)) {
+        return hashmapFillBucket(hashmap, outIndex, hash, hashmap->data[outIndex].key, len, value, false);
+    }
+    if (!hashmap->arena) {
+        return 1;
+    }
+
+    while (hashmap->size >= hashmap->tableSize || !hashmapFreeBucket(hashmap, hash % hashmap->tableSize, true, &outIndex)) {
+        const HashmapHasher* hasher = hashmap->hasher;
+        if (hashmapExpand(hashmap)) {
+            return 1;
+        }
+        if (hashmap->hasher != hasher) {
+            hash = hashmapHashFragments(hashmap, fragments, count);
+        }
+    }
+
+    // the key is assembled straight in the arena, once the expands that could move the arena are done
+    char* key = hashmapArenaReserve(hashmap->arena, len);
+    if (!key) {
+        return 1;
+    }
+    for (unsigned i = 0, offset = 0; i < count; offset += fragments[i].len, i++) {
+        memcpy(key + offset, fragments[i].bytes, fragments[i].len);
+    }
+    return hashmapFillBucket(hashmap, outIndex, hash, key, len, value, false);
+}
+
+/**
+ * @brief Get an element whose key is the concatenation of several fragments,
+ * without assembling the key
+ *
+ * @param hashmap The hashmap to get from
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @return void* The previously set element, or NULL if none exists
+ */
+void* hashmapGetFragments(const Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count) {
+    return hashmapGetHashedFragments(hashmap, hashmapHashFragments(hashmap, fragments, count), fragments, count);
+}
+
+/**
+ * @brief Get an element whose key, given in fragments, was already hashed.
+ * The fragments only verify the candidates of the hash, they aren't hashed again
+ *
+ * @param hashmap The hashmap to get from
+ * @param hash The full hash of the key, as given by hashmapHashFinal
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @return void* The previously set element, or NULL if none exists
+ */
+void* hashmapGetHashedFragments(const Hashmap* const hashmap, const unsigned hash, const HashmapKeyFragment* const fragments, const unsigned count) {
+    HASHMAP_TRACE_FRAGMENTS(HASHMAP_TRACE_GET, hashmap, fragments, count);
+    unsigned int index;
+    return hashmapFindFragments(hashmap, hash, fragments, count, hashmapFragmentsLength(fragments, count), &index) ? hashmap->data[index].data : NULL;
+}
+
+/**
+ * @brief Removes a key given as the concatenation of several fragments
+ *
+ * @param hashmap The hashmap to remove from
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapRemoveFragments(Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count) {
+    HASHMAP_TRACE_FRAGMENTS(HASHMAP_TRACE_REMOVE, hashmap, fragments, count);
+    unsigned hash = hashmapHashFragments(hashmap, fragments, count);
+    unsigned int index;
+    if (!hashmapFindFragments(hashmap, hash, fragments, count, hashmapFragmentsLength(fragments, count), &index)) {
+        return 1;
+    }
+    hashmapClearBucket(hashmap, index);
+    hashmapShrinkIfSparse(hashmap);
+    return 0;
+}
+
+/**
+ * @brief Iterate over all the elements in a hashmap applying the function f.
+ * If f returns -1, remove the item.
  * If f returns 0, do nothing.
  * otherwise stops iterating
  *
@@ -301,15 +1020,14 @@ bool hashmapGetBucket(const Hashmap* const hashmap, const char* const key, const
  * @return int 0 if the entire hashmap has been iterated over. 1 if not
  */
 int hashmapApplyIterator(Hashmap* const hashmap, int (*f)(void* const, HashmapElement* const), void* const context) {
-    for (unsigned int i = 0; i < hashmap->tableSize; i++) {
+    for (unsigned int i = 0; i < hashmap->tableSize + HASHMAP_STASH_SIZE; i++) {
         HashmapElement* elem = &hashmap->data[i];
         if (elem->used) {
             int retFlag = f(context, elem);
             switch (retFlag) {
-                case -1: {  // remove item
-                    memset(elem, 0, sizeof(HashmapElement));
-                    hashmap->size--;
-                } break;
+                case -1:  // remove item
+                    hashmapClearBucket(hashmap, i);
+                    break;
                 case 0:  // continue iterating
                     break;
                 default:  // early exit
@@ -321,19 +1039,182 @@ int hashmapApplyIterator(Hashmap* const hashmap, int (*f)(void* const, HashmapEl
 }
 
 /**
- * @brief Iterator to copy elements to a new hashmap while clearing the previous one
+ * @brief Reverses the bits of a 32 bit value
+ *
+ * @param v The value
+ * @return unsigned The value with bit 0 swapped with bit 31, 1 with 30 and so on
+ */
+static unsigned hashmapReverseBits(unsigned v) {
+    v = ((v >> 1) & 0x55555555U) | ((v & 0x55555555U) << 1);
+    v = ((v >> 2) & 0x33333333U) | ((v & 0x33333333U) << 2);
+    v = ((v >> 4) & 0x0F0F0F0FU) | ((v & 0x0F0F0F0FU) << 4);
+    v = ((v >> 8) & 0x00FF00FFU) | ((v & 0x00FF00FFU) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+/**
+ * @brief Advances a scan cursor to the next bucket in reverse binary order
+ *
+ * @param cursor The current cursor
+ * @param mask tableSize - 1
+ * @return unsigned The next cursor, 0 once every bucket was visited
+ */
+static unsigned hashmapScanNext(unsigned cursor, const unsigned mask) {
+    // increment the reversed cursor: set the bits above the mask so the carry
+    // falls off the top, reverse, add one and reverse back
+    cursor |= ~mask;
+    cursor = hashmapReverseBits(cursor);
+    cursor++;
+    return hashmapReverseBits(cursor);
+}
+
+static void hashmapScanStash(Hashmap* const hashmap, int (*f)(void* const, HashmapElement* const), void* const context) {
+    for (unsigned i = hashmap->tableSize; i < hashmap->tableSize + HASHMAP_STASH_SIZE && hashmap->stashed; i++) {
+        if (hashmap->data[i].used && f(context, &hashmap->data[i]) == -1) {
+            hashmapClearBucket(hashmap, i);
+        }
+    }
+}
+
+/**
+ * @brief Visits a few buckets of the hashmap, continuing where the previous call stopped.
+ * Buckets are visited in reverse binary order of their index, so a doubled
+ * table continues at the buckets the old ones split into: every element that
+ * stays in the hashmap during the whole scan is visited at least once, even if
+ * the hashmap expands between calls. Some elements may be visited twice.
+ * The stash is visited by the first and the last call, since an expand can
+ * move elements in and out of it.
+ * If f returns -1, remove the item.
+ * otherwise do nothing, the amount of work is bounded by count instead
+ *
+ * @param hashmap The hashmap to scan
+ * @param cursor 0 to start a scan, otherwise the value returned by the previous call
+ * @param count The number of buckets to visit in this call, at least 1
+ * @param f The function pointer to call on each element
+ * @param context The context to pass as the first argument to f
+ * @return unsigned The cursor to continue from, 0 once the scan is complete
+ */
+unsigned hashmapScan(Hashmap* const hashmap, unsigned cursor, unsigned count, int (*f)(void* const, HashmapElement* const), void* const context) {
+    const unsigned mask = hashmap->tableSize - 1;
+    if (count == 0) {
+        count = 1;
+    }
+    if (cursor == 0) {
+        hashmapScanStash(hashmap, f, context);
+    }
+
+    do {
+        unsigned home = cursor & mask;
+
+        // elements of this home bucket can't be further than the probe window
+        unsigned curr = home;
+        for (unsigned i = 0; i < HASHMAP_MAX_CHAIN_LENGTH; i++) {
+            HashmapElement* elem = &hashmap->data[curr];
+            if (elem->used && ((curr - elem->probeDist) & mask) == home && f(context, elem) == -1) {
+                hashmapClearBucket(hashmap, curr);
+            }
+            curr = (curr + 1) & mask;
+        }
+
+        cursor = hashmapScanNext(cursor, mask);
+    } while (cursor && --count);
+
+    if (cursor == 0) {
+        hashmapScanStash(hashmap, f, context);
+    }
+    return cursor;
+}
+
+/**
+ * @brief xorshift64* step used to draw random buckets
+ *
+ * @param state The generator state, never 0
+ * @return uint64_t The next random value
+ */
+static uint64_t hashmapRandom(uint64_t* const state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Draws random elements, with replacement.
+ * Each sample tries up to HASHMAP_SAMPLE_TRIES random buckets, which is
+ * uniform and takes tableSize / size tries on average. If the hashmap is so
+ * sparse that all of them are empty, the sample is the first element after
+ * the last try, which bounds the cost at the price of a slight bias.
+ * Stashed elements are only drawn when the buckets are all empty
+ *
+ * @param hashmap The hashmap to sample
+ * @param k The number of elements to draw
+ * @param out The storage for k element pointers
+ * @param rngState The random generator state, kept between calls. Any value works as a seed
+ * @return unsigned The number of elements drawn, k or 0 if the hashmap is empty
+ */
+unsigned hashmapSampleRandom(const Hashmap* const hashmap, const unsigned k, HashmapElement** const out, uint64_t* const rngState) {
+    if (hashmap->size == 0) {
+        return 0;
+    }
+    if (*rngState == 0) {
+        *rngState = 0x9E3779B97F4A7C15ULL;
+    }
+
+    const unsigned mask = hashmap->tableSize - 1;
+    for (unsigned n = 0; n < k; n++) {
+        if (hashmap->size == hashmap->stashed) {
+            unsigned curr = hashmap->tableSize + (unsigned)(hashmapRandom(rngState) >> 32) % HASHMAP_STASH_SIZE;
+            while (!hashmap->data[curr].used) {
+                curr = (curr + 1 < hashmap->tableSize + HASHMAP_STASH_SIZE) ? curr + 1 : hashmap->tableSize;
+            }
+            out[n] = &hashmap->data[curr];
+            continue;
+        }
+        unsigned curr = 0;
+        bool found = false;
+        for (unsigned i = 0; i < HASHMAP_SAMPLE_TRIES && !found; i++) {
+            curr = (unsigned)(hashmapRandom(rngState) >> 32) & mask;
+            found = hashmap->data[curr].used;
+        }
+        while (!hashmap->data[curr].used) {
+            curr = (curr + 1) & mask;
+        }
+        out[n] = &hashmap->data[curr];
+    }
+    return k;
+}
+
+/**
+ * @brief Iterator to copy elements to a new hashmap. The previous one is left
+ * as it was, so a rehash that fails partway loses nothing
  *
  * @param newHashmap The new hashmap
  * @param element The current element
- * @return int 1 if it could not copy, -1 otherwise
+ * @return int 1 if it could not copy, 0 otherwise
  */
 int hashmapRehashIterator(void* const newHashmap, HashmapElement* const element) {
-    int flag = hashmapPut((Hashmap*)newHashmap, element->key, element->keyLen, element->data);
-    if (flag) {
-        return 1;
+    return hashmapPut((Hashmap*)newHashmap, element->key, element->keyLen, element->data) != 0;
+}
+
+/**
+ * @brief Allocates a dirty bitmap with every range dirty
+ *
+ * @param slots The number of buckets it covers, stash included
+ * @param checkpoints The number of checkpoints taken so far
+ * @return HashmapDirty* The bitmap, NULL if fail
+ */
+static HashmapDirty* hashmapDirtyCreate(const unsigned slots, const unsigned checkpoints) {
+    unsigned rangeCount = (slots + HASHMAP_DIRTY_RANGE - 1) / HASHMAP_DIRTY_RANGE;
+    HashmapDirty* dirty = (HashmapDirty*)malloc(sizeof(HashmapDirty) + (rangeCount + 7) / 8);
+    if (!dirty) {
+        return NULL;
     }
-    // clear old value to avoid stale pointers
-    return -1;
+    dirty->rangeCount = rangeCount;
+    dirty->checkpoints = checkpoints;
+    memset(dirty->bits, 0xFF, (rangeCount + 7) / 8);
+    return dirty;
 }
 
 /**
@@ -345,25 +1226,364 @@ int hashmapRehashIterator(void* const newHashmap, HashmapElement* const element)
 int hashmapExpand(Hashmap* const hashmap) {
     // If this multiplication overflows hashmap_create will fail (not a power of 2)
     unsigned newSize = 2 * hashmap->tableSize;
+    HASHMAP_TRACE_OP(HASHMAP_TRACE_EXPAND, hashmap, NULL, newSize);
 
     Hashmap newHash;
     int flag = hashmapCreate(newSize, &newHash);
     if (flag)
         return flag;
 
-    // copy the old elements to the new hashmap
+    // everything gets rehashed anyway, the moment to switch to a tuned hasher
+    const HashmapHasher* tuned = hashmap->tuner ? hashmapTuneChoose(hashmap) : NULL;
+    newHash.hasher = tuned ? tuned : hashmap->hasher;
+    newHash.lowWater = hashmap->lowWater;
+
+    // and to compact a fragmented key arena: the rehash puts copy the keys into
+    // a fresh one, sized so they fit. Otherwise they keep pointing into the old one
+    HashmapKeyArena* arena = hashmap->arena;
+    hashmap->arena = NULL;
+    if (arena && hashmapArenaFragmented(arena)) {
+        newHash.arena = hashmapArenaCreate(arena->liveBytes ? arena->liveBytes : 1);
+        if (!newHash.arena) {
+            hashmap->arena = arena;
+            hashmapDestroy(&newHash);
+            return 1;
+        }
+    }
+
+    // copy the old elements to the new hashmap, the puts aren't part of the trace
+    HASHMAP_TRACE_SUPPRESS(true);
     flag = hashmapApplyIterator(hashmap, hashmapRehashIterator, (void*)&newHash);
-    if (flag)
+    HASHMAP_TRACE_SUPPRESS(false);
+    if (flag) {
+        // the old table is untouched, only the copy goes, with the fresh arena if any
+        hashmap->arena = arena;
+        hashmapDestroy(&newHash);
         return flag;
+    }
+
+    // every bucket moved, so the next checkpoint has to cover the whole table.
+    // The bitmap is made before the swap, so a failure still leaves the old table
+    if (hashmap->dirty) {
+        newHash.dirty = hashmapDirtyCreate(hashmapSlotCount(&newHash), hashmap->dirty->checkpoints);
+        if (!newHash.dirty) {
+            hashmap->arena = arena;
+            hashmapDestroy(&newHash);
+            return 1;
+        }
+    }
+
+    HashmapTuner* tuner = hashmap->tuner;
+    hashmap->tuner = NULL;
+    HashmapFrontCache* front = hashmap->front;
+    hashmap->front = NULL;
 
     hashmapDestroy(hashmap);
 
     // replace new hashmap
     memcpy(hashmap, &newHash, sizeof(Hashmap));
+    // a decided tuner is done sampling, but only once the tuned table is in place
+    if (tuned) {
+        hashmapTunerFree(tuner);
+    } else {
+        hashmap->tuner = tuner;
+    }
+    if (hashmap->arena) {
+        hashmapArenaFree(arena);
+    } else {
+        hashmap->arena = arena;
+    }
+
+    // every bucket moved, the remembered ones are useless
+    if (front) {
+        memset(front->entries, 0, (front->mask + 1) * sizeof(HashmapFrontEntry));
+        hashmap->front = front;
+    }
 
     return 0;
 }
 
+/**
+ * @brief Halves the size of the hashmap in place.
+ * An element in the lower half keeps its bucket, its distance from its home
+ * bucket is the same modulo the halved size. The elements of the upper half
+ * and of the stash are first placed in free buckets of the lower half, or
+ * set aside for the new stash. Only once every one of them has a place does
+ * the table change, so a shrink that can't place them all changes nothing.
+ * The pages left by the upper half are then given back to the system, or the
+ * allocation is reduced for a small table
+ *
+ * @param hashmap The hashmap
+ * @return int 0 if sucess 1 if fail, the hashmap is left as it was
+ */
+int hashmapShrink(Hashmap* const hashmap) {
+    if (hashmap->tableSize <= HASHMAP_SHRINK_MIN_SIZE) {
+        return 1;
+    }
+    const unsigned half = hashmap->tableSize / 2;
+    const unsigned slots = hashmapSlotCount(hashmap);
+
+    unsigned count = 0;
+    for (unsigned i = half; i < slots; i++) {
+        count += hashmap->data[i].used;
+    }
+    unsigned* placed = (unsigned*)malloc((count ? count : 1) * sizeof(unsigned));
+    // every bucket may move, the new bitmap is all dirty. Made now, so a shrink that is done can't fail
+    HashmapDirty* dirty = hashmap->dirty ? hashmapDirtyCreate(half + HASHMAP_STASH_SIZE, hashmap->dirty->checkpoints) : NULL;
+    if (!placed || (hashmap->dirty && !dirty)) {
+        free(placed);
+        free(dirty);
+        return 1;
+    }
+
+    // the buckets taken in the lower half were free, so clearing them undoes the placement
+    HashmapElement spilled[HASHMAP_STASH_SIZE];
+    unsigned placedCount = 0, spilledCount = 0;
+    bool canStash = hashmap->size < HASHMAP_STASH_MAX_LOAD * half;
+    int flag = 0;
+    for (unsigned i = half; i < slots && !flag; i++) {
+        HashmapElement elem = hashmap->data[i];
+        if (!elem.used) {
+            continue;
+        }
+        unsigned hash = hashmapHash(hashmap, elem.key, elem.keyLen);
+        unsigned curr = hash % half;
+        bool found = false;
+        for (unsigned j = 0; j < HASHMAP_MAX_CHAIN_LENGTH && !found; j++) {
+            if (!hashmap->data[curr].used) {
+                found = true;
+            } else {
+                curr = (curr + 1) % half;
+            }
+        }
+        if (found) {
+            elem.probeDist = (unsigned char)((curr - hash) & (half - 1));
+            hashmap->data[curr] = elem;
+            placed[placedCount++] = curr;
+        } else if (canStash && spilledCount < HASHMAP_STASH_SIZE) {
+            elem.probeDist = (unsigned char)((half + spilledCount - hash) & (half - 1));
+            spilled[spilledCount++] = elem;
+        } else {
+            flag = 1;
+        }
+    }
+    if (flag) {
+        for (unsigned i = 0; i < placedCount; i++) {
+            memset(&hashmap->data[placed[i]], 0, sizeof(HashmapElement));
+        }
+        free(placed);
+        free(dirty);
+        return 1;
+    }
+    free(placed);
+
+    memset(&hashmap->data[half], 0, (size_t)(slots - half) * sizeof(HashmapElement));
+    memcpy(&hashmap->data[half], spilled, spilledCount * sizeof(HashmapElement));
+    hashmap->tableSize = half;
+    hashmap->stashed = spilledCount;
+    hashmap->removals = 0;
+
+    if (hashmap->mappedBytes) {
+        // the pages past the new stash, the mapping itself stays as it is
+        long page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)&hashmap->data[hashmapSlotCount(hashmap)];
+        uintptr_t end = (uintptr_t)hashmap->data + hashmap->mappedBytes;
+        start = (start + (uintptr_t)page - 1) & ~((uintptr_t)page - 1);
+        if (start < end) {
+            madvise((void*)start, end - start, MADV_DONTNEED);
+        }
+    } else {
+        HashmapElement* data = (HashmapElement*)realloc(hashmap->data, hashmapSlotCount(hashmap) * sizeof(HashmapElement));
+        if (data) {
+            hashmap->data = data;
+        }
+    }
+
+    if (hashmap->front) {
+        memset(hashmap->front->entries, 0, (hashmap->front->mask + 1) * sizeof(HashmapFrontEntry));
+    }
+    if (dirty) {
+        free(hashmap->dirty);
+        hashmap->dirty = dirty;
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes removes halve the table once its load falls under a low-water mark.
+ * A shrink waits for tableSize / HASHMAP_SHRINK_REMOVALS removes since the last resize,
+ * which pays for it and keeps a map hovering around the mark from resizing back and forth
+ *
+ * @param hashmap The hashmap
+ * @param lowWater The load factor, up to HASHMAP_SHRINK_MAX_LOW_WATER, 0 to never shrink
+ * @return int 0 if sucess 1 if fail, the mark is out of range
+ */
+int hashmapAutoShrink(Hashmap* const hashmap, const float lowWater) {
+    if (lowWater < 0 || lowWater > HASHMAP_SHRINK_MAX_LOW_WATER) {
+        return 1;
+    }
+    hashmap->lowWater = lowWater;
+    hashmap->removals = 0;
+    return 0;
+}
+
+// time per bucket of the last maintenance task, each maintaining thread times its own
+static _Thread_local double hashmapNsPerSlot = HASHMAP_MAINTAIN_NS_PER_SLOT;
+
+static uint64_t hashmapNowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Runs a maintenance task if its estimated cost fits in what is left of the budget
+ *
+ * @param hashmap The hashmap
+ * @param task The task, hashmapExpand, hashmapShrink or hashmapCompact
+ * @param deadline The end of the budget, in hashmapNowNs time
+ * @return int 0 if the task ran 1 if it didn't fit or failed
+ */
+static int hashmapMaintainTask(Hashmap* const hashmap, int (*task)(Hashmap* const), const uint64_t deadline) {
+    const unsigned slots = hashmapSlotCount(hashmap);
+    uint64_t start = hashmapNowNs();
+    if (start + (uint64_t)(hashmapNsPerSlot * slots) > deadline) {
+        return 1;
+    }
+    int flag = task(hashmap);
+    hashmapNsPerSlot = (double)(hashmapNowNs() - start) / slots;
+    return flag;
+}
+
+/**
+ * @brief Does the housekeeping of the hashmap ahead of time, for idle moments.
+ * A table whose stash fills up, or that is too loaded to stash, is doubled
+ * before a put has to, a table under its low-water mark is halved without
+ * waiting for removes, and a fragmented key arena is compacted. A task that
+ * isn't expected to fit in the budget is left for a later call, the tasks
+ * can't be split, so a table too large for the budget never grows early
+ *
+ * @param hashmap The hashmap
+ * @param budgetNs The time the call may take, in nanoseconds
+ * @return int 0 if the hashmap needs no more work 1 if some was left for a later call
+ */
+int hashmapMaintain(Hashmap* const hashmap, const uint64_t budgetNs) {
+    const uint64_t deadline = hashmapNowNs() + budgetNs;
+
+    // not when the doubled table would be under the low-water mark, the next call would halve it
+    bool crowded = hashmap->stashed >= HASHMAP_MAINTAIN_STASH_FILL || hashmap->size >= HASHMAP_STASH_MAX_LOAD * hashmap->tableSize;
+    if (crowded && hashmap->size >= 2 * hashmap->lowWater * hashmap->tableSize) {
+        if (hashmapMaintainTask(hashmap, hashmapExpand, deadline)) {
+            return 1;
+        }
+    }
+
+    while (hashmap->lowWater > 0 && hashmap->size < hashmap->lowWater * hashmap->tableSize && hashmap->tableSize > HASHMAP_SHRINK_MIN_SIZE) {
+        if (hashmapMaintainTask(hashmap, hashmapShrink, deadline)) {
+            return 1;
+        }
+    }
+
+    if (hashmap->arena && hashmapArenaFragmented(hashmap->arena)) {
+        return hashmapMaintainTask(hashmap, hashmapCompact, deadline);
+    }
+    return 0;
+}
+
+/**
+ * @brief Number of elements of data, the buckets followed by the stash
+ *
+ * @param hashmap The hashmap
+ * @return unsigned The number of slots
+ */
+unsigned hashmapSlotCount(const Hashmap* const hashmap) {
+    return hashmap->tableSize + HASHMAP_STASH_SIZE;
+}
+
+/**
+ * @brief Adds a direct mapped cache of recently found keys in front of hashmapGet.
+ * Entries are indexed by key pointer and checked against the bucket they
+ * point to, so they never need invalidating: removed, moved or replaced keys
+ * just miss. Only helps when lookups reuse the key pointers, like interned keys.
+ * A hashmap owning its keys stores copies, which never match, so it can't have one
+ *
+ * @param hashmap The hashmap
+ * @param entries The number of entries, rounded up to a power of two, up to HASHMAP_FRONT_MAX_ENTRIES
+ * @return int 0 if sucess 1 if fail, too many entries or the hashmap owns its keys
+ */
+int hashmapEnableFrontCache(Hashmap* const hashmap, const unsigned entries) {
+    if (entries > HASHMAP_FRONT_MAX_ENTRIES || hashmap->arena) {
+        return 1;
+    }
+    unsigned count = 1;
+    while (count < entries) {
+        count *= 2;
+    }
+
+    HashmapFrontCache* front = (HashmapFrontCache*)calloc(1, sizeof(HashmapFrontCache) + count * sizeof(HashmapFrontEntry));
+    if (!front) {
+        return 1;
+    }
+    front->mask = count - 1;
+
+    free(hashmap->front);
+    hashmap->front = front;
+    return 0;
+}
+
+/**
+ * @brief Start tracking which bucket ranges change, with every range dirty
+ *
+ * @param hashmap The hashmap to track
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapTrackDirty(Hashmap* const hashmap) {
+    HashmapDirty* dirty = hashmapDirtyCreate(hashmapSlotCount(hashmap), hashmap->dirty ? hashmap->dirty->checkpoints : 0);
+    if (!dirty) {
+        return 1;
+    }
+
+    free(hashmap->dirty);
+    hashmap->dirty = dirty;
+    return 0;
+}
+
+/**
+ * @brief Marks the range of a bucket as changed. Dirty tracking must be on
+ *
+ * @param hashmap The tracked hashmap
+ * @param index The index of the changed bucket
+ */
+void hashmapMarkDirty(Hashmap* const hashmap, const unsigned index) {
+    unsigned range = index / HASHMAP_DIRTY_RANGE;
+    hashmap->dirty->bits[range / 8] |= (unsigned char)(1u << (range % 8));
+}
+
+/**
+ * @brief Checks if a bucket range changed since the last checkpoint
+ *
+ * @param hashmap The hashmap
+ * @param range The index of the range
+ * @return bool If the range changed, always true if tracking is off
+ */
+bool hashmapIsRangeDirty(const Hashmap* const hashmap, const unsigned range) {
+    if (!hashmap->dirty) {
+        return true;
+    }
+    return (hashmap->dirty->bits[range / 8] >> (range % 8)) & 1;
+}
+
+/**
+ * @brief Marks every range as clean, called once a checkpoint is written
+ *
+ * @param hashmap The tracked hashmap
+ */
+void hashmapClearDirty(Hashmap* const hashmap) {
+    if (hashmap->dirty) {
+        memset(hashmap->dirty->bits, 0, (hashmap->dirty->rangeCount + 7) / 8);
+    }
+}
+
 /**
  * @brief Iterator that logs strings and frees them
  *
@@ -0,0 +1,193 @@
+/**
+ * @file hashmapArena.c
+ * @brief Implements the arena holding the keys of a hashmap that owns them
+ */
+
+#include "../header/hashmapArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static HashmapArenaChunk* hashmapArenaChunk(HashmapKeyArena* const arena, const size_t size) {
+    HashmapArenaChunk* chunk = (HashmapArenaChunk*)malloc(sizeof(HashmapArenaChunk) + size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    arena->reservedBytes += size;
+    return chunk;
+}
+
+/**
+ * @brief Makes an empty hashmap copy the keys put into it.
+ * The copies never match the key pointers of the lookups, so a hashmap with a
+ * front cache can't own its keys
+ *
+ * @param hashmap The hashmap
+ * @return int 0 if sucess 1 if fail, the hashmap isn't empty or has a front cache
+ */
+int hashmapOwnKeys(Hashmap* const hashmap) {
+    if (hashmap->arena) {
+        return 0;
+    }
+    if (hashmap->size || hashmap->front) {
+        return 1;
+    }
+    hashmap->arena = hashmapArenaCreate(0);
+    return hashmap->arena == NULL;
+}
+
+/**
+ * @brief Moves the live keys of a hashmap owning its keys into a fresh arena,
+ * when enough of the current one is dead
+ *
+ * @param hashmap The hashmap
+ * @return int 0 if sucess 1 if fail, the hashmap is left as it was
+ */
+int hashmapCompact(Hashmap* const hashmap) {
+    HashmapKeyArena* old = hashmap->arena;
+    if (!old || !hashmapArenaFragmented(old)) {
+        return 0;
+    }
+
+    // sized for every live key, so the copies below can't fail halfway
+    HashmapKeyArena* arena = hashmapArenaCreate(old->liveBytes ? old->liveBytes : 1);
+    if (!arena) {
+        return 1;
+    }
+    for (unsigned i = 0; i < hashmapSlotCount(hashmap); i++) {
+        HashmapElement* elem = &hashmap->data[i];
+        if (elem->used) {
+            elem->key = hashmapArenaCopy(arena, elem->key, elem->keyLen);
+        }
+    }
+    hashmapArenaFree(old);
+    hashmap->arena = arena;
+
+    // the remembered key pointers are gone
+    if (hashmap->front) {
+        memset(hashmap->front->entries, 0, (hashmap->front->mask + 1) * sizeof(HashmapFrontEntry));
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates an arena
+ *
+ * @param capacity The bytes of the first chunk, 0 to allocate it with the first key
+ * @return HashmapKeyArena* The arena, NULL if out of memory
+ */
+HashmapKeyArena* hashmapArenaCreate(const size_t capacity) {
+    HashmapKeyArena* arena = (HashmapKeyArena*)calloc(1, sizeof(HashmapKeyArena));
+    if (!arena || !capacity) {
+        return arena;
+    }
+    arena->chunks = hashmapArenaChunk(arena, capacity);
+    if (!arena->chunks) {
+        free(arena);
+        return NULL;
+    }
+    arena->chunks->next = NULL;
+    return arena;
+}
+
+/**
+ * @brief Reserves the bytes of a key in the arena, for the caller to fill
+ *
+ * @param arena The arena
+ * @param len The length of the key
+ * @return char* The reserved bytes, NULL if out of memory
+ */
+char* hashmapArenaReserve(HashmapKeyArena* const arena, const unsigned len) {
+    HashmapArenaChunk* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < len) {
+        if (len > HASHMAP_ARENA_BIG_KEY) {
+            // a chunk of its own, behind the one being filled
+            HashmapArenaChunk* big = hashmapArenaChunk(arena, len);
+            if (!big) {
+                return NULL;
+            }
+            big->used = len;
+            if (chunk) {
+                big->next = chunk->next;
+                chunk->next = big;
+            } else {
+                big->next = NULL;
+                arena->chunks = big;
+            }
+            arena->liveBytes += len;
+            return big->bytes;
+        }
+
+        HashmapArenaChunk* next = hashmapArenaChunk(arena, HASHMAP_ARENA_CHUNK);
+        if (!next) {
+            return NULL;
+        }
+        if (chunk) {
+            // the tail is too short for this key, count it lost
+            arena->deadBytes += chunk->size - chunk->used;
+            chunk->used = chunk->size;
+        }
+        next->next = chunk;
+        arena->chunks = next;
+        chunk = next;
+    }
+
+    char* bytes = chunk->bytes + chunk->used;
+    chunk->used += len;
+    arena->liveBytes += len;
+    return bytes;
+}
+
+/**
+ * @brief Copies a key into the arena
+ *
+ * @param arena The arena
+ * @param key The key
+ * @param len The length of the key
+ * @return const char* The copy, NULL if out of memory
+ */
+const char* hashmapArenaCopy(HashmapKeyArena* const arena, const char* const key, const unsigned len) {
+    char* copy = hashmapArenaReserve(arena, len);
+    return (copy && len) ? (const char*)memcpy(copy, key, len) : copy;
+}
+
+/**
+ * @brief Counts the bytes of a removed key as dead
+ *
+ * @param arena The arena
+ * @param len The length of the key
+ */
+void hashmapArenaRelease(HashmapKeyArena* const arena, const unsigned len) {
+    arena->liveBytes -= len;
+    arena->deadBytes += len;
+}
+
+/**
+ * @brief Tells if compacting the arena would give back enough memory
+ *
+ * @param arena The arena
+ * @return bool If the dead bytes pass the threshold
+ */
+bool hashmapArenaFragmented(const HashmapKeyArena* const arena) {
+    return arena->deadBytes >= HASHMAP_ARENA_MIN_DEAD && (double)arena->deadBytes > HASHMAP_ARENA_DEAD_RATIO * (double)arena->liveBytes;
+}
+
+/**
+ * @brief Frees an arena and every key in it
+ *
+ * @param arena The arena, may be NULL
+ */
+void hashmapArenaFree(HashmapKeyArena* const arena) {
+    if (!arena) {
+        return;
+    }
+    HashmapArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        HashmapArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
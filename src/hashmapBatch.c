@@ -0,0 +1,67 @@
+/**
+ * @file hashmapBatch.c
+ * @brief Implements batched gets and puts fed by the multi-key hashing kernel
+ *
+ * Keys go through in groups of HASHMAP_BATCH_SIZE: the group is hashed with
+ * hashmapHashBatch, the home buckets of all its keys are prefetched, then
+ * each key is probed, so the cache misses of the group overlap too.
+ */
+
+#include "../header/hashmapBatch.h"
+
+static void hashmapBatchPrefetch(const Hashmap* const hashmap, const unsigned* const hashes, const unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        __builtin_prefetch(&hashmap->data[hashes[i] % hashmap->tableSize]);
+    }
+}
+
+/**
+ * @brief Gets several elements from the hashmap. The front cache isn't used
+ *
+ * @param hashmap The hashmap to get from
+ * @param keys The string keys to use
+ * @param lens The lengths of the string keys
+ * @param count The number of keys
+ * @param outValues The storage for the count elements, NULL for the missing ones
+ */
+void hashmapGetBatch(const Hashmap* const hashmap, const char* const* const keys, const unsigned* const lens, const unsigned count, void** const outValues) {
+    unsigned hashes[HASHMAP_BATCH_SIZE];
+    for (unsigned first = 0; first < count; first += HASHMAP_BATCH_SIZE) {
+        unsigned n = (count - first < HASHMAP_BATCH_SIZE) ? count - first : HASHMAP_BATCH_SIZE;
+        hashmapHashBatch(hashmap, keys + first, lens + first, n, hashes);
+        hashmapBatchPrefetch(hashmap, hashes, n);
+        for (unsigned i = 0; i < n; i++) {
+            outValues[first + i] = hashmapGetHashed(hashmap, hashes[i], keys[first + i], lens[first + i]);
+        }
+    }
+}
+
+/**
+ * @brief Puts several elements into the hashmap, in order, like a bulk build
+ *
+ * @param hashmap The hashmap to insert into
+ * @param keys The string keys to use
+ * @param lens The lengths of the string keys
+ * @param values The values to insert
+ * @param count The number of keys
+ * @return int 0 if sucess 1 if fail, the keys before the failing one are in
+ */
+int hashmapPutBatch(Hashmap* const hashmap, const char* const* const keys, const unsigned* const lens, void* const* const values, const unsigned count) {
+    unsigned hashes[HASHMAP_BATCH_SIZE];
+    for (unsigned first = 0; first < count; first += HASHMAP_BATCH_SIZE) {
+        unsigned n = (count - first < HASHMAP_BATCH_SIZE) ? count - first : HASHMAP_BATCH_SIZE;
+        hashmapHashBatch(hashmap, keys + first, lens + first, n, hashes);
+        hashmapBatchPrefetch(hashmap, hashes, n);
+        for (unsigned i = 0; i < n; i++) {
+            const HashmapHasher* hasher = hashmap->hasher;
+            if (hashmapPutHashed(hashmap, hashes[i], keys[first + i], lens[first + i], values[first + i])) {
+                return 1;
+            }
+            // an expand may have tuned the hasher, the rest of the group needs new hashes
+            if (hashmap->hasher != hasher && i + 1 < n) {
+                hashmapHashBatch(hashmap, keys + first + i + 1, lens + first + i + 1, n - i - 1, hashes + i + 1);
+            }
+        }
+    }
+    return 0;
+}
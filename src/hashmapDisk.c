@@ -0,0 +1,513 @@
+/**
+ * @file hashmapDisk.c
+ * @brief Implements a disk resident hashmap using extendible hashing
+ *
+ * The directory isn't stored: every page records its local depth and prefix,
+ * so opening a file rebuilds the directory from one pass over the pages.
+ * Changes reach the file when their frame is evicted, or at the latest with
+ * hashmapDiskSync or hashmapDiskClose.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapDisk.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Gives access to a page, read from the file if it isn't cached
+ *
+ * @param disk The disk hashmap
+ * @param page The page number
+ * @param write If the page will be changed
+ * @return char* The page bytes, valid until the next call, NULL if the file couldn't be read
+ */
+static char* hashmapDiskFetch(HashmapDisk* const disk, const uint32_t page, const bool write) {
+    if (disk->mapping) {
+        return disk->mapping + (size_t)page * HASHMAP_DISK_PAGE;
+    }
+
+    HashmapDiskFrame* frame = (HashmapDiskFrame*)hashmapGet(&disk->frameIndex, (const char*)&page, sizeof(page));
+    if (frame) {
+        disk->hits++;
+        frame->referenced = true;
+        frame->dirty |= write;
+        return frame->bytes;
+    }
+    disk->misses++;
+
+    // clock: frames used since the hand last passed get a second chance
+    for (;;) {
+        frame = &disk->frames[disk->hand];
+        disk->hand = (disk->hand + 1) % disk->frameCount;
+        if (!frame->referenced) {
+            break;
+        }
+        frame->referenced = false;
+    }
+
+    if (frame->page) {
+        if (frame->dirty && pwrite(disk->fd, frame->bytes, HASHMAP_DISK_PAGE, (off_t)frame->page * HASHMAP_DISK_PAGE) != HASHMAP_DISK_PAGE) {
+            return NULL;
+        }
+        hashmapRemove(&disk->frameIndex, (const char*)&frame->page, sizeof(frame->page));
+        frame->page = 0;
+    }
+
+    // pages allocated since the last write back are past the end of the file
+    ssize_t got = pread(disk->fd, frame->bytes, HASHMAP_DISK_PAGE, (off_t)page * HASHMAP_DISK_PAGE);
+    if (got < 0) {
+        return NULL;
+    }
+    memset(frame->bytes + got, 0, HASHMAP_DISK_PAGE - (size_t)got);
+
+    frame->page = page;
+    if (hashmapPut(&disk->frameIndex, (const char*)&frame->page, sizeof(frame->page), frame)) {
+        frame->page = 0;
+        return NULL;
+    }
+    frame->referenced = true;
+    frame->dirty = write;
+    return frame->bytes;
+}
+
+/**
+ * @brief Adds an empty page at the end of the file
+ *
+ * @param disk The disk hashmap
+ * @param outPage The new page number
+ * @return int 0 if sucess 1 if fail
+ */
+static int hashmapDiskAllocPage(HashmapDisk* const disk, uint32_t* const outPage) {
+    size_t bytes = ((size_t)disk->pageCount + 1) * HASHMAP_DISK_PAGE;
+    if (disk->mapping && bytes > disk->mappingBytes) {
+        // the file grows ahead of the pages, so the mapping rarely moves
+        size_t grown = disk->mappingBytes * 2;
+        if (ftruncate(disk->fd, (off_t)grown)) {
+            return 1;
+        }
+        void* mapping = mremap(disk->mapping, disk->mappingBytes, grown, MREMAP_MAYMOVE);
+        if (mapping == MAP_FAILED) {
+            return 1;
+        }
+        disk->mapping = (char*)mapping;
+        disk->mappingBytes = grown;
+    }
+    *outPage = disk->pageCount++;
+    return 0;
+}
+
+/**
+ * @brief Looks for a key in a page
+ *
+ * @param bytes The page
+ * @param hash The hash of the key
+ * @param key The key
+ * @param len The length of the key
+ * @return long The offset of its record, -1 if absent
+ */
+static long hashmapDiskFind(const char* const bytes, const uint32_t hash, const char* const key, const unsigned len) {
+    const HashmapDiskPage* page = (const HashmapDiskPage*)bytes;
+    size_t offset = sizeof(HashmapDiskPage);
+    size_t end = offset + page->used;
+    while (offset < end) {
+        HashmapDiskRecord record;
+        memcpy(&record, bytes + offset, sizeof(record));
+        if (record.hash == hash && record.keyLen == len && memcmp(bytes + offset + sizeof(record), key, len) == 0) {
+            return (long)offset;
+        }
+        offset += sizeof(record) + record.keyLen + record.valLen;
+    }
+    return -1;
+}
+
+static unsigned hashmapDiskRecordSize(const char* const bytes, const long offset) {
+    HashmapDiskRecord record;
+    memcpy(&record, bytes + offset, sizeof(record));
+    return (unsigned)sizeof(record) + record.keyLen + record.valLen;
+}
+
+static void hashmapDiskErase(char* const bytes, const long offset) {
+    HashmapDiskPage* page = (HashmapDiskPage*)bytes;
+    unsigned size = hashmapDiskRecordSize(bytes, offset);
+    size_t end = sizeof(HashmapDiskPage) + page->used;
+    memmove(bytes + offset, bytes + offset + size, end - (size_t)offset - size);
+    page->used -= (uint16_t)size;
+    page->count--;
+}
+
+/**
+ * @brief Copies the records of a page whose hash has a given bit to another page
+ *
+ * @param from The page split
+ * @param to The page receiving the records
+ * @param bit The bit telling the two pages apart
+ * @param set Copies the records having the bit if true, the others otherwise
+ */
+static void hashmapDiskDistribute(const char* const from, char* const to, const uint32_t bit, const bool set) {
+    const HashmapDiskPage* source = (const HashmapDiskPage*)from;
+    HashmapDiskPage* target = (HashmapDiskPage*)to;
+    size_t offset = sizeof(HashmapDiskPage);
+    size_t end = offset + source->used;
+    while (offset < end) {
+        HashmapDiskRecord record;
+        memcpy(&record, from + offset, sizeof(record));
+        size_t size = sizeof(record) + record.keyLen + record.valLen;
+        if (((record.hash & bit) != 0) == set) {
+            memcpy(to + sizeof(HashmapDiskPage) + target->used, from + offset, size);
+            target->used += (uint16_t)size;
+            target->count++;
+        }
+        offset += size;
+    }
+}
+
+/**
+ * @brief Splits a full page on the next bit of the hash, doubling the directory if needed
+ *
+ * @param disk The disk hashmap
+ * @param pageNo The page to split
+ * @return int 0 if sucess 1 if fail
+ */
+static int hashmapDiskSplit(HashmapDisk* const disk, const uint32_t pageNo) {
+    char old[HASHMAP_DISK_PAGE];
+    const char* bytes = hashmapDiskFetch(disk, pageNo, false);
+    if (!bytes) {
+        return 1;
+    }
+    memcpy(old, bytes, HASHMAP_DISK_PAGE);
+    HashmapDiskPage header;
+    memcpy(&header, old, sizeof(header));
+
+    if (header.localDepth == disk->globalDepth) {
+        if (disk->globalDepth == HASHMAP_DISK_MAX_DEPTH) {
+            return 1;
+        }
+        size_t entries = (size_t)1 << disk->globalDepth;
+        uint32_t* directory = (uint32_t*)realloc(disk->directory, 2 * entries * sizeof(uint32_t));
+        if (!directory) {
+            return 1;
+        }
+        memcpy(directory + entries, directory, entries * sizeof(uint32_t));
+        disk->directory = directory;
+        disk->globalDepth++;
+    }
+
+    uint32_t newNo;
+    if (hashmapDiskAllocPage(disk, &newNo)) {
+        return 1;
+    }
+    uint32_t bit = (uint32_t)1 << header.localDepth;
+
+    // one page at a time, a single frame is enough
+    HashmapDiskPage low = {.localDepth = header.localDepth + 1, .prefix = header.prefix, .count = 0, .used = 0};
+    char* target = hashmapDiskFetch(disk, pageNo, true);
+    if (!target) {
+        return 1;
+    }
+    memcpy(target, &low, sizeof(low));
+    hashmapDiskDistribute(old, target, bit, false);
+
+    HashmapDiskPage high = {.localDepth = header.localDepth + 1, .prefix = header.prefix | bit, .count = 0, .used = 0};
+    target = hashmapDiskFetch(disk, newNo, true);
+    if (!target) {
+        return 1;
+    }
+    memcpy(target, &high, sizeof(high));
+    hashmapDiskDistribute(old, target, bit, true);
+
+    size_t entries = (size_t)1 << disk->globalDepth;
+    for (size_t i = high.prefix; i < entries; i += (size_t)bit << 1) {
+        disk->directory[i] = newNo;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuilds the directory from the depth and prefix of every page
+ *
+ * @param disk The disk hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+static int hashmapDiskLoadDirectory(HashmapDisk* const disk) {
+    disk->globalDepth = 0;
+    for (uint32_t p = 1; p < disk->pageCount; p++) {
+        const HashmapDiskPage* page = (const HashmapDiskPage*)hashmapDiskFetch(disk, p, false);
+        if (!page || page->localDepth > HASHMAP_DISK_MAX_DEPTH) {
+            return 1;
+        }
+        if (page->localDepth > disk->globalDepth) {
+            disk->globalDepth = page->localDepth;
+        }
+    }
+
+    size_t entries = (size_t)1 << disk->globalDepth;
+    disk->directory = (uint32_t*)calloc(entries, sizeof(uint32_t));
+    if (!disk->directory) {
+        return 1;
+    }
+    for (uint32_t p = 1; p < disk->pageCount; p++) {
+        const HashmapDiskPage* page = (const HashmapDiskPage*)hashmapDiskFetch(disk, p, false);
+        if (!page) {
+            return 1;
+        }
+        for (size_t i = page->prefix; i < entries; i += (size_t)1 << page->localDepth) {
+            disk->directory[i] = p;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens a disk hashmap, creating the file if needed
+ *
+ * @param path The file of the pages
+ * @param cacheBytes The size of the page cache, ignored with mmap
+ * @param useMmap Access the pages in a shared mapping instead of the page cache
+ * @param outDisk The storage for the opened hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapDiskOpen(const char* const path, const size_t cacheBytes, const bool useMmap, HashmapDisk* const outDisk) {
+    memset(outDisk, 0, sizeof(HashmapDisk));
+    outDisk->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (outDisk->fd < 0) {
+        return 1;
+    }
+
+    struct stat st;
+    HashmapDiskHeader header;
+    bool created = fstat(outDisk->fd, &st) == 0 && st.st_size == 0;
+    if (created) {
+        outDisk->pageCount = 1;
+    } else if (pread(outDisk->fd, &header, sizeof(header), 0) != sizeof(header) ||
+               memcmp(header.magic, HASHMAP_DISK_MAGIC, sizeof(header.magic)) != 0 || header.pageSize != HASHMAP_DISK_PAGE) {
+        hashmapDiskClose(outDisk);
+        return 1;
+    } else {
+        outDisk->pageCount = header.pageCount;
+        outDisk->size = header.size;
+    }
+
+    int flag = 0;
+    if (useMmap) {
+        size_t bytes = (size_t)HASHMAP_DISK_PAGE * 2;
+        while (bytes < (size_t)outDisk->pageCount * HASHMAP_DISK_PAGE || bytes < (size_t)st.st_size) {
+            bytes *= 2;
+        }
+        flag = ftruncate(outDisk->fd, (off_t)bytes) != 0;
+        void* mapping = flag ? MAP_FAILED : mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, outDisk->fd, 0);
+        if (mapping != MAP_FAILED) {
+            outDisk->mapping = (char*)mapping;
+            outDisk->mappingBytes = bytes;
+        }
+        flag = mapping == MAP_FAILED;
+    } else {
+        outDisk->frameCount = cacheBytes / HASHMAP_DISK_PAGE ? (unsigned)(cacheBytes / HASHMAP_DISK_PAGE) : 1;
+        unsigned indexSize = 2;
+        while (indexSize < 2 * outDisk->frameCount) {
+            indexSize *= 2;
+        }
+        outDisk->frames = (HashmapDiskFrame*)calloc(outDisk->frameCount, sizeof(HashmapDiskFrame));
+        outDisk->frameBytes = (char*)malloc((size_t)outDisk->frameCount * HASHMAP_DISK_PAGE);
+        flag = !outDisk->frames || !outDisk->frameBytes || hashmapCreate(indexSize, &outDisk->frameIndex);
+        for (unsigned i = 0; i < outDisk->frameCount && !flag; i++) {
+            outDisk->frames[i].bytes = outDisk->frameBytes + (size_t)i * HASHMAP_DISK_PAGE;
+        }
+    }
+
+    if (!flag && created) {
+        // a single page of depth 0 holds every key
+        uint32_t first;
+        outDisk->directory = (uint32_t*)calloc(1, sizeof(uint32_t));
+        flag = !outDisk->directory || hashmapDiskAllocPage(outDisk, &first);
+        char* bytes = flag ? NULL : hashmapDiskFetch(outDisk, first, true);
+        if (bytes) {
+            memset(bytes, 0, sizeof(HashmapDiskPage));
+            outDisk->directory[0] = first;
+        }
+        flag = flag || !bytes || hashmapDiskSync(outDisk);
+    } else if (!flag) {
+        flag = hashmapDiskLoadDirectory(outDisk);
+    }
+
+    if (flag) {
+        hashmapDiskClose(outDisk);
+    }
+    return flag;
+}
+
+/**
+ * @brief Put a copy of a value in the disk hashmap, replacing the previous one
+ *
+ * @param disk The disk hashmap
+ * @param key The key
+ * @param len The length of the key
+ * @param value The value bytes
+ * @param valLen The number of value bytes
+ * @return int 0 if sucess 1 if fail, the record doesn't fit in a page or the file couldn't grow
+ */
+int hashmapDiskPut(HashmapDisk* const disk, const char* const key, const unsigned len, const void* const value, const unsigned valLen) {
+    if ((size_t)len + valLen > HASHMAP_DISK_MAX_RECORD) {
+        return 1;
+    }
+    HashmapDiskRecord record = {.hash = hashmapCRC32(key, len), .keyLen = (uint16_t)len, .valLen = (uint16_t)valLen};
+    unsigned need = (unsigned)sizeof(record) + len + valLen;
+
+    for (;;) {
+        uint32_t pageNo = disk->directory[record.hash & (((uint32_t)1 << disk->globalDepth) - 1)];
+        char* bytes = hashmapDiskFetch(disk, pageNo, true);
+        if (!bytes) {
+            return 1;
+        }
+        HashmapDiskPage* page = (HashmapDiskPage*)bytes;
+        long at = hashmapDiskFind(bytes, record.hash, key, len);
+        unsigned available = HASHMAP_DISK_PAGE - (unsigned)sizeof(HashmapDiskPage) - page->used + (at >= 0 ? hashmapDiskRecordSize(bytes, at) : 0);
+
+        if (need <= available) {
+            if (at >= 0) {
+                hashmapDiskErase(bytes, at);
+                disk->size--;
+            }
+            char* dst = bytes + sizeof(HashmapDiskPage) + page->used;
+            memcpy(dst, &record, sizeof(record));
+            memcpy(dst + sizeof(record), key, len);
+            if (valLen) {
+                memcpy(dst + sizeof(record) + len, value, valLen);
+            }
+            page->used += (uint16_t)need;
+            page->count++;
+            disk->size++;
+            return 0;
+        }
+
+        // the old record, if any, moves with the split and is replaced after
+        if (hashmapDiskSplit(disk, pageNo)) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Get a copy of the value of a key
+ *
+ * @param disk The disk hashmap
+ * @param key The key
+ * @param len The length of the key
+ * @param value Receives up to capacity bytes of the value
+ * @param capacity The size of value
+ * @param outLen Receives the full length of the value, may be NULL
+ * @return int 0 if found 1 otherwise
+ */
+int hashmapDiskGet(HashmapDisk* const disk, const char* const key, const unsigned len, void* const value, const unsigned capacity, unsigned* const outLen) {
+    uint32_t hash = hashmapCRC32(key, len);
+    const char* bytes = hashmapDiskFetch(disk, disk->directory[hash & (((uint32_t)1 << disk->globalDepth) - 1)], false);
+    long at = bytes ? hashmapDiskFind(bytes, hash, key, len) : -1;
+    if (at < 0) {
+        return 1;
+    }
+
+    HashmapDiskRecord record;
+    memcpy(&record, bytes + at, sizeof(record));
+    if (capacity) {
+        memcpy(value, bytes + at + sizeof(record) + len, record.valLen < capacity ? record.valLen : capacity);
+    }
+    if (outLen) {
+        *outLen = record.valLen;
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes a key from the disk hashmap
+ *
+ * @param disk The disk hashmap
+ * @param key The key
+ * @param len The length of the key
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapDiskRemove(HashmapDisk* const disk, const char* const key, const unsigned len) {
+    uint32_t hash = hashmapCRC32(key, len);
+    uint32_t pageNo = disk->directory[hash & (((uint32_t)1 << disk->globalDepth) - 1)];
+    const char* bytes = hashmapDiskFetch(disk, pageNo, false);
+    long at = bytes ? hashmapDiskFind(bytes, hash, key, len) : -1;
+    if (at < 0) {
+        return 1;
+    }
+
+    // cached by the lookup, this only marks it dirty
+    char* page = hashmapDiskFetch(disk, pageNo, true);
+    if (!page) {
+        return 1;
+    }
+    hashmapDiskErase(page, at);
+    disk->size--;
+    return 0;
+}
+
+/**
+ * @brief Writes every change and the header to the file
+ *
+ * @param disk The disk hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapDiskSync(HashmapDisk* const disk) {
+    HashmapDiskHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HASHMAP_DISK_MAGIC, sizeof(header.magic));
+    header.pageSize = HASHMAP_DISK_PAGE;
+    header.pageCount = disk->pageCount;
+    header.size = disk->size;
+
+    if (disk->mapping) {
+        memcpy(disk->mapping, &header, sizeof(header));
+        return msync(disk->mapping, (size_t)disk->pageCount * HASHMAP_DISK_PAGE, MS_SYNC) != 0;
+    }
+
+    int flag = 0;
+    for (unsigned i = 0; i < disk->frameCount; i++) {
+        HashmapDiskFrame* frame = &disk->frames[i];
+        if (frame->page && frame->dirty) {
+            if (pwrite(disk->fd, frame->bytes, HASHMAP_DISK_PAGE, (off_t)frame->page * HASHMAP_DISK_PAGE) != HASHMAP_DISK_PAGE) {
+                flag = 1;
+                continue;
+            }
+            frame->dirty = false;
+        }
+    }
+    flag |= pwrite(disk->fd, &header, sizeof(header), 0) != sizeof(header);
+    flag |= fsync(disk->fd) != 0;
+    return flag;
+}
+
+/**
+ * @brief Syncs and closes a disk hashmap
+ *
+ * @param disk The disk hashmap
+ * @return int 0 if sucess 1 if the last changes couldn't be written
+ */
+int hashmapDiskClose(HashmapDisk* const disk) {
+    int flag = 0;
+    if (disk->fd >= 0 && disk->directory) {
+        flag = hashmapDiskSync(disk);
+    }
+    if (disk->mapping) {
+        munmap(disk->mapping, disk->mappingBytes);
+    }
+    if (disk->frameIndex.data) {
+        hashmapDestroy(&disk->frameIndex);
+    }
+    free(disk->frames);
+    free(disk->frameBytes);
+    free(disk->directory);
+    if (disk->fd >= 0) {
+        close(disk->fd);
+    }
+    memset(disk, 0, sizeof(HashmapDisk));
+    disk->fd = -1;
+    return flag;
+}
@@ -0,0 +1,382 @@
+/**
+ * @file hashmapExport.c
+ * @brief Implements a parallel export of a hashmap to Arrow compatible columns
+ *
+ * The table is split in one contiguous slice of buckets per thread. A first
+ * pass counts the rows and key bytes of every slice, a prefix sum turns them
+ * into output positions and a second pass fills the columns, so no thread
+ * ever writes where another one does.
+ *
+ * The key views find the chunk of a key by a binary search over the arena
+ * chunks, sorted by address.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapExport.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../header/hashmapArena.h"
+
+typedef struct {
+    const Hashmap* hashmap;
+    unsigned first;
+    unsigned last;
+    unsigned rows;
+    uint64_t keyBytes;
+    unsigned longestKey;
+    unsigned rowStart;
+    uint64_t byteStart;
+    HashmapColumns* columns;
+    HashmapKeyViewColumns* views;
+    bool foreignKey;  // a key outside the arena, the views can't point to it
+    HashmapValueExtractor extractor;
+    void* context;
+} HashmapExportSlice;
+
+static size_t hashmapExportAlign(const size_t size) {
+    return (size + HASHMAP_EXPORT_ALIGNMENT - 1) & ~(size_t)(HASHMAP_EXPORT_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Zeroes the padding after a buffer, up to its aligned size
+ *
+ * @param buffer The buffer
+ * @param used The bytes written by the export
+ * @param size The aligned size of the buffer
+ */
+static void hashmapExportZeroTail(void* const buffer, const size_t used, const size_t size) {
+    memset((char*)buffer + used, 0, size - used);
+}
+
+static void* hashmapExportCount(void* const arg) {
+    HashmapExportSlice* slice = (HashmapExportSlice*)arg;
+    const HashmapElement* data = slice->hashmap->data;
+    for (unsigned i = slice->first; i < slice->last; i++) {
+        if (data[i].used) {
+            slice->rows++;
+            slice->keyBytes += data[i].keyLen;
+            if (data[i].keyLen > slice->longestKey) {
+                slice->longestKey = data[i].keyLen;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* hashmapExportFill(void* const arg) {
+    HashmapExportSlice* slice = (HashmapExportSlice*)arg;
+    const HashmapElement* data = slice->hashmap->data;
+    HashmapColumns* columns = slice->columns;
+
+    unsigned row = slice->rowStart;
+    int64_t offset = (int64_t)slice->byteStart;
+    for (unsigned i = slice->first; i < slice->last; i++) {
+        if (!data[i].used) {
+            continue;
+        }
+        columns->keyOffsets[row] = offset;
+        memcpy(columns->keyData + offset, data[i].key, data[i].keyLen);
+        offset += data[i].keyLen;
+        columns->values[row] = slice->extractor ? slice->extractor(data[i].data, slice->context) : (uint64_t)(uintptr_t)data[i].data;
+        row++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the arena chunk holding a key
+ *
+ * @param columns The columns, with the chunks sorted by address
+ * @param key The key
+ * @param outBuffer The index of the chunk
+ * @return bool If a chunk holds the key
+ */
+static bool hashmapExportFindBuffer(const HashmapKeyViewColumns* const columns, const char* const key, unsigned* const outBuffer) {
+    // the last chunk starting at or before the key
+    unsigned low = 0, high = columns->bufferCount;
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if ((uintptr_t)columns->buffers[mid] <= (uintptr_t)key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0 || (uintptr_t)key >= (uintptr_t)columns->buffers[low - 1] + (uintptr_t)columns->bufferSizes[low - 1]) {
+        return false;
+    }
+    *outBuffer = low - 1;
+    return true;
+}
+
+static void* hashmapExportFillViews(void* const arg) {
+    HashmapExportSlice* slice = (HashmapExportSlice*)arg;
+    const HashmapElement* data = slice->hashmap->data;
+    HashmapKeyViewColumns* columns = slice->views;
+
+    unsigned row = slice->rowStart;
+    for (unsigned i = slice->first; i < slice->last; i++) {
+        if (!data[i].used) {
+            continue;
+        }
+        // the unused inline bytes must be zero
+        HashmapKeyView* view = &columns->keyViews[row];
+        memset(view, 0, sizeof(HashmapKeyView));
+        view->inlined.len = (int32_t)data[i].keyLen;
+        if (data[i].keyLen <= HASHMAP_EXPORT_VIEW_INLINE) {
+            memcpy(view->inlined.bytes, data[i].key, data[i].keyLen);
+        } else {
+            unsigned buffer;
+            if (!hashmapExportFindBuffer(columns, data[i].key, &buffer)) {
+                slice->foreignKey = true;
+                return NULL;
+            }
+            memcpy(view->ref.prefix, data[i].key, sizeof(view->ref.prefix));
+            view->ref.buffer = (int32_t)buffer;
+            view->ref.offset = (int32_t)(data[i].key - columns->buffers[buffer]);
+        }
+        columns->values[row] = slice->extractor ? slice->extractor(data[i].data, slice->context) : (uint64_t)(uintptr_t)data[i].data;
+        row++;
+    }
+    return NULL;
+}
+
+static int hashmapExportCompareChunks(const void* const a, const void* const b) {
+    uintptr_t x = (uintptr_t)*(const HashmapArenaChunk* const*)a;
+    uintptr_t y = (uintptr_t)*(const HashmapArenaChunk* const*)b;
+    return (x > y) - (x < y);
+}
+
+static void hashmapExportRun(HashmapExportSlice* const slices, const unsigned count, void* (*task)(void*)) {
+    pthread_t* threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    unsigned started = 0;
+    if (threads) {
+        for (; started + 1 < count; started++) {
+            if (pthread_create(&threads[started], NULL, task, &slices[started])) {
+                break;
+            }
+        }
+    }
+
+    // whatever couldn't get a thread runs here
+    for (unsigned i = started; i < count; i++) {
+        task(&slices[i]);
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * @brief Splits the table in slices and counts the rows and key bytes of each one,
+ * with their positions in the output
+ *
+ * @param hashmap The hashmap to export
+ * @param extractor Turns a value into its column entry, NULL to export the value pointers
+ * @param context The context to pass as the last argument to extractor
+ * @param threads The number of threads to use, 0 for one per online core
+ * @param outCount The number of slices
+ * @return HashmapExportSlice* The slices, NULL if fail. Free them with free
+ */
+static HashmapExportSlice* hashmapExportSlices(const Hashmap* const hashmap, HashmapValueExtractor extractor, void* const context, const unsigned threads, unsigned* const outCount) {
+    unsigned sliceCount = threads;
+    if (sliceCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        sliceCount = (cores > 0) ? (unsigned)cores : 1;
+    }
+    if (sliceCount > hashmap->tableSize) {
+        sliceCount = hashmap->tableSize;
+    }
+
+    HashmapExportSlice* slices = (HashmapExportSlice*)calloc(sliceCount, sizeof(HashmapExportSlice));
+    if (!slices) {
+        return NULL;
+    }
+    unsigned step = hashmap->tableSize / sliceCount;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].hashmap = hashmap;
+        slices[i].first = i * step;
+        slices[i].last = (i + 1 == sliceCount) ? hashmapSlotCount(hashmap) : (i + 1) * step;
+        slices[i].extractor = extractor;
+        slices[i].context = context;
+    }
+
+    hashmapExportRun(slices, sliceCount, hashmapExportCount);
+
+    unsigned rows = 0;
+    uint64_t keyBytes = 0;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].rowStart = rows;
+        slices[i].byteStart = keyBytes;
+        rows += slices[i].rows;
+        keyBytes += slices[i].keyBytes;
+    }
+    *outCount = sliceCount;
+    return slices;
+}
+
+/**
+ * @brief Exports every element of the hashmap as a key column and a value column
+ *
+ * @param hashmap The hashmap to export. It must not change during the export
+ * @param extractor Turns a value into its column entry, NULL to export the value pointers
+ * @param context The context to pass as the last argument to extractor
+ * @param threads The number of threads to use, 0 for one per online core
+ * @param outColumns The exported columns, free them with hashmapColumnsFree
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapExportColumns(const Hashmap* const hashmap, HashmapValueExtractor extractor, void* const context, const unsigned threads, HashmapColumns* const outColumns) {
+    memset(outColumns, 0, sizeof(HashmapColumns));
+
+    unsigned sliceCount;
+    HashmapExportSlice* slices = hashmapExportSlices(hashmap, extractor, context, threads, &sliceCount);
+    if (!slices) {
+        return 1;
+    }
+    HashmapExportSlice* last = &slices[sliceCount - 1];
+    unsigned rows = last->rowStart + last->rows;
+    uint64_t keyBytes = last->byteStart + last->keyBytes;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].columns = outColumns;
+    }
+
+    size_t offsetsSize = hashmapExportAlign(((size_t)rows + 1) * sizeof(int64_t));
+    size_t keysSize = hashmapExportAlign((size_t)keyBytes);
+    size_t valuesSize = hashmapExportAlign((size_t)rows * sizeof(uint64_t));
+    outColumns->blockSize = offsetsSize + keysSize + valuesSize;
+    outColumns->block = aligned_alloc(HASHMAP_EXPORT_ALIGNMENT, outColumns->blockSize);
+    if (!outColumns->block) {
+        free(slices);
+        return 1;
+    }
+
+    outColumns->length = rows;
+    outColumns->keyOffsets = (int64_t*)outColumns->block;
+    outColumns->keyData = (char*)outColumns->block + offsetsSize;
+    outColumns->values = (uint64_t*)((char*)outColumns->block + offsetsSize + keysSize);
+    outColumns->keyOffsets[rows] = (int64_t)keyBytes;
+
+    // Arrow wants the padding zeroed, the rest is written once by the fill
+    hashmapExportZeroTail(outColumns->keyOffsets, ((size_t)rows + 1) * sizeof(int64_t), offsetsSize);
+    hashmapExportZeroTail(outColumns->keyData, (size_t)keyBytes, keysSize);
+    hashmapExportZeroTail(outColumns->values, (size_t)rows * sizeof(uint64_t), valuesSize);
+
+    hashmapExportRun(slices, sliceCount, hashmapExportFill);
+
+    free(slices);
+    return 0;
+}
+
+/**
+ * @brief Frees exported columns
+ *
+ * @param columns The columns to free
+ */
+void hashmapColumnsFree(HashmapColumns* const columns) {
+    free(columns->block);
+    memset(columns, 0, sizeof(HashmapColumns));
+}
+
+/**
+ * @brief Exports every element of a hashmap owning its keys as a key view column
+ * and a value column, the key bytes stay in the key arena
+ *
+ * @param hashmap The hashmap to export, owning its keys. It must not change while the columns are used
+ * @param extractor Turns a value into its column entry, NULL to export the value pointers
+ * @param context The context to pass as the last argument to extractor
+ * @param threads The number of threads to use, 0 for one per online core
+ * @param outColumns The exported columns, free them with hashmapKeyViewColumnsFree
+ * @return int 0 if sucess 1 if fail, the hashmap doesn't own its keys
+ */
+int hashmapExportKeyViews(const Hashmap* const hashmap, HashmapValueExtractor extractor, void* const context, const unsigned threads, HashmapKeyViewColumns* const outColumns) {
+    memset(outColumns, 0, sizeof(HashmapKeyViewColumns));
+    if (!hashmap->arena) {
+        return 1;
+    }
+
+    unsigned chunkCount = 0;
+    for (const HashmapArenaChunk* chunk = hashmap->arena->chunks; chunk; chunk = chunk->next) {
+        chunkCount++;
+    }
+    const HashmapArenaChunk** chunks = (const HashmapArenaChunk**)malloc((chunkCount ? chunkCount : 1) * sizeof(HashmapArenaChunk*));
+    unsigned sliceCount;
+    HashmapExportSlice* slices = chunks ? hashmapExportSlices(hashmap, extractor, context, threads, &sliceCount) : NULL;
+    if (!slices) {
+        free(chunks);
+        return 1;
+    }
+    HashmapExportSlice* last = &slices[sliceCount - 1];
+    unsigned rows = last->rowStart + last->rows;
+    bool tooLong = false;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].views = outColumns;
+        tooLong |= slices[i].longestKey > INT32_MAX;
+    }
+
+    size_t viewsSize = hashmapExportAlign((size_t)rows * sizeof(HashmapKeyView));
+    size_t valuesSize = hashmapExportAlign((size_t)rows * sizeof(uint64_t));
+    size_t buffersSize = hashmapExportAlign((size_t)chunkCount * sizeof(const char*));
+    size_t sizesSize = hashmapExportAlign((size_t)chunkCount * sizeof(int64_t));
+    outColumns->blockSize = viewsSize + valuesSize + buffersSize + sizesSize;
+    outColumns->block = tooLong ? NULL : aligned_alloc(HASHMAP_EXPORT_ALIGNMENT, outColumns->blockSize ? outColumns->blockSize : HASHMAP_EXPORT_ALIGNMENT);
+    if (!outColumns->block) {
+        free(chunks);
+        free(slices);
+        outColumns->blockSize = 0;
+        return 1;
+    }
+
+    outColumns->length = rows;
+    outColumns->bufferCount = chunkCount;
+    outColumns->keyViews = (HashmapKeyView*)outColumns->block;
+    outColumns->values = (uint64_t*)((char*)outColumns->block + viewsSize);
+    outColumns->buffers = (const char**)((char*)outColumns->block + viewsSize + valuesSize);
+    outColumns->bufferSizes = (int64_t*)((char*)outColumns->block + viewsSize + valuesSize + buffersSize);
+
+    // the buffers in address order, for the binary search of the fill
+    unsigned c = 0;
+    for (const HashmapArenaChunk* chunk = hashmap->arena->chunks; chunk; chunk = chunk->next) {
+        chunks[c++] = chunk;
+    }
+    qsort(chunks, chunkCount, sizeof(HashmapArenaChunk*), hashmapExportCompareChunks);
+    for (unsigned i = 0; i < chunkCount; i++) {
+        outColumns->buffers[i] = chunks[i]->bytes;
+        outColumns->bufferSizes[i] = (int64_t)chunks[i]->used;
+    }
+    free(chunks);
+
+    hashmapExportZeroTail(outColumns->keyViews, (size_t)rows * sizeof(HashmapKeyView), viewsSize);
+    hashmapExportZeroTail(outColumns->values, (size_t)rows * sizeof(uint64_t), valuesSize);
+    hashmapExportZeroTail(outColumns->buffers, (size_t)chunkCount * sizeof(const char*), buffersSize);
+    hashmapExportZeroTail(outColumns->bufferSizes, (size_t)chunkCount * sizeof(int64_t), sizesSize);
+
+    hashmapExportRun(slices, sliceCount, hashmapExportFillViews);
+
+    bool foreignKey = false;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        foreignKey |= slices[i].foreignKey;
+    }
+    free(slices);
+    if (foreignKey) {
+        hashmapKeyViewColumnsFree(outColumns);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Frees exported key view columns, the key arena is left alone
+ *
+ * @param columns The columns to free
+ */
+void hashmapKeyViewColumnsFree(HashmapKeyViewColumns* const columns) {
+    free(columns->block);
+    memset(columns, 0, sizeof(HashmapKeyViewColumns));
+}
@@ -0,0 +1,136 @@
+/**
+ * @file hashmapHandle.c
+ * @brief Implements a handle to a read-only hashmap that can be replaced while readers use it
+ *
+ * Readers register in one of two counters, picked by the parity of the epoch
+ * they saw, before loading the map pointer. After swapping the pointer a
+ * writer first drains the counter of the next epoch (stragglers of an older
+ * epoch), flips the epoch so new readers move to that counter, and then
+ * drains the counter of the current epoch. New readers always land on the
+ * counter that isn't being drained, so the writer can't be starved.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapHandle.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Create a handle publishing an initial map
+ *
+ * @param outHandle The storage for the created handle
+ * @param initial The initial map, moved into the handle. May be NULL to start empty. It can't have a front cache
+ * @param retireIterator Iterator used to destroy the elements of replaced maps, NULL if they own nothing
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapHandleCreate(HashmapHandle* const outHandle, Hashmap* const initial, int (*retireIterator)(void* const, HashmapElement* const)) {
+    Hashmap* map = NULL;
+    if (initial) {
+        if (initial->front) {
+            return 1;
+        }
+        map = (Hashmap*)malloc(sizeof(Hashmap));
+        if (!map) {
+            return 1;
+        }
+        memcpy(map, initial, sizeof(Hashmap));
+        memset(initial, 0, sizeof(Hashmap));
+    }
+
+    atomic_init(&outHandle->current, map);
+    atomic_init(&outHandle->epoch, 0);
+    atomic_init(&outHandle->readers[0], 0);
+    atomic_init(&outHandle->readers[1], 0);
+    outHandle->retireIterator = retireIterator;
+    pthread_mutex_init(&outHandle->publishLock, NULL);
+    return 0;
+}
+
+/**
+ * @brief Starts reading the current map. Never blocks
+ *
+ * @param handle The handle
+ * @return HashmapReadGuard The current map, NULL if none was published, to hand back to hashmapHandleRelease
+ */
+HashmapReadGuard hashmapHandleAcquire(HashmapHandle* const handle) {
+    HashmapReadGuard guard;
+    guard.slot = atomic_load(&handle->epoch) & 1;
+    atomic_fetch_add(&handle->readers[guard.slot], 1);
+    // loaded after registering, so a writer either waits for us or we see its map
+    guard.map = atomic_load(&handle->current);
+    return guard;
+}
+
+/**
+ * @brief Stops reading a map acquired with hashmapHandleAcquire
+ *
+ * @param handle The handle
+ * @param guard The guard returned by hashmapHandleAcquire
+ */
+void hashmapHandleRelease(HashmapHandle* const handle, const HashmapReadGuard guard) {
+    atomic_fetch_sub(&handle->readers[guard.slot], 1);
+}
+
+static void hashmapHandleDrain(HashmapHandle* const handle, const unsigned slot) {
+    while (atomic_load(&handle->readers[slot]) != 0) {
+        sched_yield();
+    }
+}
+
+static void hashmapHandleRetire(HashmapHandle* const handle, Hashmap* const map) {
+    if (!map) {
+        return;
+    }
+    if (handle->retireIterator) {
+        hashmapDestroyWithOwnership(map, handle->retireIterator);
+    } else {
+        hashmapDestroy(map);
+    }
+    free(map);
+}
+
+/**
+ * @brief Replaces the published map. Readers keep going, only this call waits
+ * for the readers of the old map before destroying it
+ *
+ * @param handle The handle
+ * @param fresh The fully built new map, moved into the handle. It must not be modified afterwards, nor have a front cache
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapHandlePublish(HashmapHandle* const handle, Hashmap* const fresh) {
+    if (fresh->front) {
+        return 1;
+    }
+    Hashmap* map = (Hashmap*)malloc(sizeof(Hashmap));
+    if (!map) {
+        return 1;
+    }
+    memcpy(map, fresh, sizeof(Hashmap));
+    memset(fresh, 0, sizeof(Hashmap));
+
+    pthread_mutex_lock(&handle->publishLock);
+    Hashmap* old = atomic_exchange(&handle->current, map);
+
+    unsigned epoch = atomic_load(&handle->epoch);
+    hashmapHandleDrain(handle, (epoch + 1) & 1);
+    atomic_store(&handle->epoch, epoch + 1);
+    hashmapHandleDrain(handle, epoch & 1);
+    pthread_mutex_unlock(&handle->publishLock);
+
+    hashmapHandleRetire(handle, old);
+    return 0;
+}
+
+/**
+ * @brief Destroy the handle and its map. No reader may be using it
+ *
+ * @param handle The handle to destroy
+ */
+void hashmapHandleDestroy(HashmapHandle* const handle) {
+    hashmapHandleRetire(handle, atomic_load(&handle->current));
+    pthread_mutex_destroy(&handle->publishLock);
+    memset(handle, 0, sizeof(HashmapHandle));
+}
@@ -0,0 +1,193 @@
+/**
+ * @file hashmapHasher.c
+ * @brief Implements the candidate hashers and the auto-tune mode that picks one
+ *
+ * Every candidate is streaming so keys given in pieces hash like whole ones.
+ * The table CRC32C is the default, FNV-1a and x31 trade some distribution
+ * quality for speed on short keys.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapHasher.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned hashmapFNV1aUpdate(unsigned state, const char* const s, const unsigned len) {
+    for (unsigned i = 0; i < len; i++) {
+        state = (state ^ (unsigned char)s[i]) * 16777619U;
+    }
+    return state;
+}
+
+static unsigned hashmapX31Update(unsigned state, const char* const s, const unsigned len) {
+    for (unsigned i = 0; i < len; i++) {
+        state = state * 31 + (unsigned char)s[i];
+    }
+    return state;
+}
+
+const HashmapHasher hashmapCRC32Hasher = {.name = "crc32c", .seed = 0, .update = hashmapCRC32Update};
+const HashmapHasher hashmapFNV1aHasher = {.name = "fnv1a", .seed = 2166136261U, .update = hashmapFNV1aUpdate};
+const HashmapHasher hashmapX31Hasher = {.name = "x31", .seed = 0, .update = hashmapX31Update};
+
+static const HashmapHasher* const hashmapTuneCandidates[] = {&hashmapCRC32Hasher, &hashmapFNV1aHasher, &hashmapX31Hasher};
+
+/**
+ * @brief Changes the hasher of an empty hashmap
+ *
+ * @param hashmap The hashmap
+ * @param hasher The new hasher
+ * @return int 0 if sucess 1 if fail, the hashmap isn't empty
+ */
+int hashmapSetHasher(Hashmap* const hashmap, const HashmapHasher* const hasher) {
+    if (hashmap->size) {
+        return 1;
+    }
+    hashmap->hasher = hasher;
+    return 0;
+}
+
+/**
+ * @brief Starts sampling the inserted keys to pick a hasher at a later expand
+ *
+ * @param hashmap The hashmap to tune
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapAutoTune(Hashmap* const hashmap) {
+    if (hashmap->tuner) {
+        return 0;
+    }
+    hashmap->tuner = (HashmapTuner*)calloc(1, sizeof(HashmapTuner));
+    return hashmap->tuner == NULL;
+}
+
+/**
+ * @brief Keeps a copy of a newly inserted key, until there are enough samples
+ *
+ * @param tuner The tuner of the hashmap
+ * @param key The key
+ * @param len The length of the key
+ */
+void hashmapTuneRecord(HashmapTuner* const tuner, const char* const key, const unsigned len) {
+    if (tuner->count == HASHMAP_TUNE_SAMPLES) {
+        return;
+    }
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) {
+        return;
+    }
+    if (len) {
+        memcpy(copy, key, len);
+    }
+    tuner->keys[tuner->count] = copy;
+    tuner->lens[tuner->count] = len;
+    tuner->count++;
+}
+
+static double hashmapTuneTime(const HashmapTuner* const tuner, const HashmapHasher* const hasher) {
+    volatile unsigned sink = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned r = 0; r < HASHMAP_TUNE_ROUNDS; r++) {
+        for (unsigned i = 0; i < tuner->count; i++) {
+            sink ^= hasher->update(hasher->seed, tuner->keys[i], tuner->lens[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    return (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+}
+
+/**
+ * @brief Mean probe length of the samples inserted in a half full table
+ *
+ * @param tuner The tuner holding the samples
+ * @param hasher The candidate hasher
+ * @param used Scratch space for the simulated table
+ * @param tableSize The size of the simulated table, a power of two
+ * @return double The mean distance of the samples from their home bucket
+ */
+static double hashmapTuneProbes(const HashmapTuner* const tuner, const HashmapHasher* const hasher, bool* const used, const unsigned tableSize) {
+    Hashmap simulated = {.tableSize = tableSize, .hasher = hasher};
+    memset(used, 0, tableSize * sizeof(bool));
+
+    unsigned long total = 0;
+    for (unsigned i = 0; i < tuner->count; i++) {
+        unsigned curr = hashmapStringHasher(&simulated, tuner->keys[i], tuner->lens[i]);
+        while (used[curr]) {
+            curr = (curr + 1) & (tableSize - 1);
+            total++;
+        }
+        used[curr] = true;
+    }
+    return (double)total / tuner->count;
+}
+
+/**
+ * @brief Picks the hasher for the table being rebuilt by hashmapExpand.
+ * The tuner is left alone, hashmapExpand frees it once the new table is in place
+ *
+ * @param hashmap The hashmap being expanded
+ * @return const HashmapHasher* The hasher for the new table, NULL if not decided yet
+ */
+const HashmapHasher* hashmapTuneChoose(const Hashmap* const hashmap) {
+    const HashmapTuner* tuner = hashmap->tuner;
+    if (tuner->count < HASHMAP_TUNE_MIN_SAMPLES) {
+        return NULL;
+    }
+
+    unsigned tableSize = 1;
+    while (tableSize < 2 * tuner->count) {
+        tableSize *= 2;
+    }
+    bool* used = (bool*)malloc(tableSize * sizeof(bool));
+    if (!used) {
+        return NULL;
+    }
+
+    const unsigned candidates = sizeof(hashmapTuneCandidates) / sizeof(hashmapTuneCandidates[0]);
+    double probes[sizeof(hashmapTuneCandidates) / sizeof(hashmapTuneCandidates[0])];
+    double bestProbes = 0;
+    for (unsigned c = 0; c < candidates; c++) {
+        probes[c] = hashmapTuneProbes(tuner, hashmapTuneCandidates[c], used, tableSize);
+        if (c == 0 || probes[c] < bestProbes) {
+            bestProbes = probes[c];
+        }
+    }
+    free(used);
+
+    // the fastest of the candidates that distribute well enough, the small
+    // constant keeps a perfect best from rejecting everyone else
+    const HashmapHasher* chosen = NULL;
+    double bestTime = 0;
+    for (unsigned c = 0; c < candidates; c++) {
+        if (probes[c] > bestProbes * HASHMAP_TUNE_PROBE_SLACK + 0.05) {
+            continue;
+        }
+        double time = hashmapTuneTime(tuner, hashmapTuneCandidates[c]);
+        if (!chosen || time < bestTime) {
+            chosen = hashmapTuneCandidates[c];
+            bestTime = time;
+        }
+    }
+
+    return chosen;
+}
+
+/**
+ * @brief Frees a tuner and its samples
+ *
+ * @param tuner The tuner, may be NULL
+ */
+void hashmapTunerFree(HashmapTuner* const tuner) {
+    if (!tuner) {
+        return;
+    }
+    for (unsigned i = 0; i < tuner->count; i++) {
+        free(tuner->keys[i]);
+    }
+    free(tuner);
+}
@@ -0,0 +1,379 @@
+/**
+ * @file hashmapLinear.c
+ * @brief Implements a hashmap growing one bucket at a time with linear hashing
+ *
+ * A split moves the elements of one chain into two, and the overflow buckets
+ * it empties are reused by the two new chains, which never need more of them.
+ */
+
+#include "../header/hashmapLinear.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/hashmapHasher.h"
+
+static HashmapLinearBucket* hashmapLinearBucketAt(const HashmapLinear* const hashmap, const unsigned index) {
+    return &hashmap->segments[index / HASHMAP_LINEAR_SEGMENT][index % HASHMAP_LINEAR_SEGMENT];
+}
+
+static unsigned hashmapLinearHash(const HashmapLinear* const hashmap, const char* const key, const unsigned len) {
+    Hashmap view = {.hasher = hashmap->hasher};
+    return hashmapHash(&view, key, len);
+}
+
+/**
+ * @brief Picks the bucket of a hash, with the two levels of linear hashing
+ *
+ * @param hashmap The hashmap
+ * @param hash The hash of the key
+ * @return unsigned The index of the bucket
+ */
+static unsigned hashmapLinearAddress(const HashmapLinear* const hashmap, const unsigned hash) {
+    unsigned low = hashmap->initialBuckets << hashmap->level;
+    unsigned index = hash & (low - 1);
+    // buckets before the split pointer already use the next level
+    if (index < hashmap->split) {
+        index = hash & (2 * low - 1);
+    }
+    return index;
+}
+
+static HashmapElement* hashmapLinearFind(HashmapLinearBucket* bucket, const unsigned hash, const char* const key, const unsigned len) {
+    uint16_t fingerprint = hashmapFingerprint(hash);
+    for (; bucket; bucket = bucket->overflow) {
+        for (unsigned i = 0; i < HASHMAP_LINEAR_SLOTS; i++) {
+            HashmapElement* elem = &bucket->slots[i];
+            if (!elem->used) {
+                return NULL;
+            }
+            if (hashmapCheckIfMatch(elem, fingerprint, key, len)) {
+                return elem;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Adds an element at the end of a chain
+ *
+ * @param hashmap The hashmap
+ * @param bucket The first bucket of the chain
+ * @param elem The element
+ * @param spare Overflow buckets to take before allocating, may be NULL
+ * @return int 0 if sucess 1 if fail
+ */
+static int hashmapLinearAppend(HashmapLinear* const hashmap, HashmapLinearBucket* bucket, const HashmapElement* const elem, HashmapLinearBucket** const spare) {
+    while (bucket->overflow) {
+        bucket = bucket->overflow;
+    }
+    unsigned i = 0;
+    while (i < HASHMAP_LINEAR_SLOTS && bucket->slots[i].used) {
+        i++;
+    }
+
+    if (i == HASHMAP_LINEAR_SLOTS) {
+        HashmapLinearBucket* overflow;
+        if (spare && *spare) {
+            overflow = *spare;
+            *spare = overflow->overflow;
+            memset(overflow, 0, sizeof(HashmapLinearBucket));
+        } else {
+            overflow = (HashmapLinearBucket*)calloc(1, sizeof(HashmapLinearBucket));
+            if (!overflow) {
+                return 1;
+            }
+            hashmap->overflowCount++;
+        }
+        bucket->overflow = overflow;
+        bucket = overflow;
+        i = 0;
+    }
+    bucket->slots[i] = *elem;
+    return 0;
+}
+
+/**
+ * @brief Removes an element by moving the last one of its chain in its place
+ *
+ * @param hashmap The hashmap
+ * @param bucket The first bucket of the chain
+ * @param elem The element to remove
+ * @return bool If another element took its place
+ */
+static bool hashmapLinearErase(HashmapLinear* const hashmap, HashmapLinearBucket* const bucket, HashmapElement* const elem) {
+    HashmapLinearBucket* before = NULL;
+    HashmapLinearBucket* last = bucket;
+    while (last->overflow) {
+        before = last;
+        last = last->overflow;
+    }
+    unsigned i = HASHMAP_LINEAR_SLOTS;
+    while (i > 0 && !last->slots[i - 1].used) {
+        i--;
+    }
+
+    HashmapElement* tail = &last->slots[i - 1];
+    bool moved = tail != elem;
+    if (moved) {
+        *elem = *tail;
+    }
+    memset(tail, 0, sizeof(HashmapElement));
+
+    // an emptied overflow bucket goes, the chain stays packed
+    if (i == 1 && before) {
+        before->overflow = NULL;
+        free(last);
+        hashmap->overflowCount--;
+    }
+    hashmap->size--;
+    return moved;
+}
+
+/**
+ * @brief Allocates the segment holding a bucket index, if not there yet
+ *
+ * @param hashmap The hashmap
+ * @param index The bucket index
+ * @return int 0 if sucess 1 if fail
+ */
+static int hashmapLinearReserve(HashmapLinear* const hashmap, const unsigned index) {
+    unsigned segment = index / HASHMAP_LINEAR_SEGMENT;
+    if (segment < hashmap->segmentCount) {
+        return 0;
+    }
+    if (segment == hashmap->segmentCap) {
+        unsigned cap = hashmap->segmentCap ? hashmap->segmentCap * 2 : 4;
+        HashmapLinearBucket** segments = (HashmapLinearBucket**)realloc(hashmap->segments, cap * sizeof(HashmapLinearBucket*));
+        if (!segments) {
+            return 1;
+        }
+        hashmap->segments = segments;
+        hashmap->segmentCap = cap;
+    }
+    hashmap->segments[segment] = (HashmapLinearBucket*)calloc(HASHMAP_LINEAR_SEGMENT, sizeof(HashmapLinearBucket));
+    if (!hashmap->segments[segment]) {
+        return 1;
+    }
+    hashmap->segmentCount++;
+    return 0;
+}
+
+/**
+ * @brief Splits the bucket under the split pointer into itself and a new last bucket
+ *
+ * @param hashmap The hashmap
+ * @return int 0 if sucess 1 if fail, the hashmap is left as it was
+ */
+static int hashmapLinearSplit(HashmapLinear* const hashmap) {
+    unsigned low = hashmap->initialBuckets << hashmap->level;
+    unsigned target = hashmap->split + low;
+    if (target < hashmap->split || hashmapLinearReserve(hashmap, target)) {
+        return 1;
+    }
+
+    HashmapLinearBucket* bucket = hashmapLinearBucketAt(hashmap, hashmap->split);
+    HashmapLinearBucket* sibling = hashmapLinearBucketAt(hashmap, target);
+    HashmapLinearBucket first = *bucket;
+    memset(bucket, 0, sizeof(HashmapLinearBucket));
+    hashmap->bucketCount++;
+
+    // the overflow buckets are reused once their elements moved out
+    HashmapLinearBucket* spare = NULL;
+    HashmapLinearBucket* next = first.overflow;
+    HashmapElement moving[HASHMAP_LINEAR_SLOTS];
+    memcpy(moving, first.slots, sizeof(moving));
+    for (;;) {
+        for (unsigned i = 0; i < HASHMAP_LINEAR_SLOTS && moving[i].used; i++) {
+            unsigned hash = hashmapLinearHash(hashmap, moving[i].key, moving[i].keyLen);
+            hashmapLinearAppend(hashmap, (hash & low) ? sibling : bucket, &moving[i], &spare);
+        }
+        if (!next) {
+            break;
+        }
+        memcpy(moving, next->slots, sizeof(moving));
+        HashmapLinearBucket* consumed = next;
+        next = next->overflow;
+        consumed->overflow = spare;
+        spare = consumed;
+    }
+    while (spare) {
+        HashmapLinearBucket* unused = spare;
+        spare = spare->overflow;
+        free(unused);
+        hashmap->overflowCount--;
+    }
+
+    if (++hashmap->split == low) {
+        hashmap->level++;
+        hashmap->split = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Create a linear hashing hashmap
+ *
+ * @param initialBuckets The initial number of buckets. Must be a power of two
+ * @param outHashmap The storage for the created hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapLinearCreate(const unsigned initialBuckets, HashmapLinear* const outHashmap) {
+    memset(outHashmap, 0, sizeof(HashmapLinear));
+    outHashmap->initialBuckets = initialBuckets;
+    outHashmap->bucketCount = initialBuckets;
+    outHashmap->hasher = &hashmapCRC32Hasher;
+
+    // check if non zero power of two
+    if (initialBuckets == 0 || ((initialBuckets & (initialBuckets - 1)) != 0)) {
+        return 1;
+    }
+    for (unsigned index = 0; index < initialBuckets; index += HASHMAP_LINEAR_SEGMENT) {
+        if (hashmapLinearReserve(outHashmap, index)) {
+            hashmapLinearDestroy(outHashmap);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Put an element into the hashmap, then split a bucket if the load calls for it
+ *
+ * @param hashmap The hashmap to insert into
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param value The value to insert
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapLinearPut(HashmapLinear* const hashmap, const char* const key, const unsigned len, void* const value) {
+    unsigned hash = hashmapLinearHash(hashmap, key, len);
+    HashmapLinearBucket* bucket = hashmapLinearBucketAt(hashmap, hashmapLinearAddress(hashmap, hash));
+    HashmapElement* elem = hashmapLinearFind(bucket, hash, key, len);
+    if (elem) {
+        elem->key = key;
+        elem->data = value;
+        return 0;
+    }
+
+    HashmapElement added = {.key = key, .keyLen = len, .used = true, .probeDist = 0, .fingerprint = hashmapFingerprint(hash), .data = value};
+    if (hashmapLinearAppend(hashmap, bucket, &added, NULL)) {
+        return 1;
+    }
+    hashmap->size++;
+
+    // the element is in, a failed split only leaves a longer chain until the next put
+    if (hashmap->size > HASHMAP_LINEAR_LOAD * HASHMAP_LINEAR_SLOTS * hashmap->bucketCount) {
+        hashmapLinearSplit(hashmap);
+    }
+    return 0;
+}
+
+/**
+ * @brief Get an element from the hashmap
+ *
+ * @param hashmap The hashmap to get from
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return void* The previously set element, or NULL if none exists
+ */
+void* hashmapLinearGet(const HashmapLinear* const hashmap, const char* const key, const unsigned len) {
+    unsigned hash = hashmapLinearHash(hashmap, key, len);
+    HashmapElement* elem = hashmapLinearFind(hashmapLinearBucketAt(hashmap, hashmapLinearAddress(hashmap, hash)), hash, key, len);
+    return elem ? elem->data : NULL;
+}
+
+/**
+ * @brief Removes a key from the hashmap
+ *
+ * @param hashmap The hashmap to remove from
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapLinearRemove(HashmapLinear* const hashmap, const char* const key, const unsigned len) {
+    unsigned hash = hashmapLinearHash(hashmap, key, len);
+    HashmapLinearBucket* bucket = hashmapLinearBucketAt(hashmap, hashmapLinearAddress(hashmap, hash));
+    HashmapElement* elem = hashmapLinearFind(bucket, hash, key, len);
+    if (!elem) {
+        return 1;
+    }
+    hashmapLinearErase(hashmap, bucket, elem);
+    return 0;
+}
+
+/**
+ * @brief Iterate over all the elements in the hashmap
+ * If f returns -1, remove the item.
+ * If f returns 0, do nothing.
+ * otherwise stop the iteration
+ *
+ * @param hashmap The hashmap to iterate over
+ * @param f The function pointer to call on each element
+ * @param context The context to pass as the first argument to f
+ * @return int 0 if the entire hashmap has been iterated over. 1 if not
+ */
+int hashmapLinearApplyIterator(HashmapLinear* const hashmap, int (*f)(void* const, HashmapElement* const), void* const context) {
+    for (unsigned b = 0; b < hashmap->bucketCount; b++) {
+        HashmapLinearBucket* bucket = hashmapLinearBucketAt(hashmap, b);
+        HashmapLinearBucket* node = bucket;
+        unsigned i = 0;
+        while (node) {
+            if (i == HASHMAP_LINEAR_SLOTS) {
+                node = node->overflow;
+                i = 0;
+                continue;
+            }
+            HashmapElement* elem = &node->slots[i];
+            if (!elem->used) {
+                break;
+            }
+            switch (f(context, elem)) {
+                case -1:  // remove item, the last one of the chain takes its place
+                    if (!hashmapLinearErase(hashmap, bucket, elem)) {
+                        node = NULL;
+                    }
+                    break;
+                case 0:  // continue iterating
+                    i++;
+                    break;
+                default:  // early exit
+                    return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Bytes allocated by the hashmap, the elements themselves excluded
+ *
+ * @param hashmap The hashmap
+ * @return size_t The bytes of the segments, overflow buckets and segment directory
+ */
+size_t hashmapLinearMemory(const HashmapLinear* const hashmap) {
+    return (size_t)hashmap->segmentCount * HASHMAP_LINEAR_SEGMENT * sizeof(HashmapLinearBucket) +
+           hashmap->overflowCount * sizeof(HashmapLinearBucket) + hashmap->segmentCap * sizeof(HashmapLinearBucket*);
+}
+
+/**
+ * @brief Destroy the hashmap
+ *
+ * @param hashmap The hashmap to destroy
+ */
+void hashmapLinearDestroy(HashmapLinear* const hashmap) {
+    for (unsigned b = 0; b < hashmap->bucketCount && b / HASHMAP_LINEAR_SEGMENT < hashmap->segmentCount; b++) {
+        HashmapLinearBucket* overflow = hashmapLinearBucketAt(hashmap, b)->overflow;
+        while (overflow) {
+            HashmapLinearBucket* next = overflow->overflow;
+            free(overflow);
+            overflow = next;
+        }
+    }
+    for (unsigned s = 0; s < hashmap->segmentCount; s++) {
+        free(hashmap->segments[s]);
+    }
+    free(hashmap->segments);
+    memset(hashmap, 0, sizeof(HashmapLinear));
+}
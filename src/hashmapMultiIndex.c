@@ -0,0 +1,151 @@
+/**
+ * @file hashmapMultiIndex.c
+ * @brief Implements one set of records indexed both by a string key and by an integer field
+ */
+
+#include "../header/hashmapMultiIndex.h"
+
+/**
+ * @brief Create a multi index container
+ *
+ * @param initialSize The initial size of both indexes. Must be a power of two
+ * @param key Gives the string key of a record
+ * @param field Gives the integer field of a record
+ * @param outIndex The storage for the created container
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapMultiIndexCreate(const unsigned initialSize, HashmapRecordKey key, HashmapRecordField field, HashmapMultiIndex* const outIndex) {
+    outIndex->key = key;
+    outIndex->field = field;
+    if (hashmapCreate(initialSize, &outIndex->byKey)) {
+        return 1;
+    }
+    if (hashmapCreate(initialSize, &outIndex->byField)) {
+        hashmapDestroy(&outIndex->byKey);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Insert a record into both indexes
+ *
+ * @param index The container
+ * @param record The record, it must outlive its stay in the container
+ * @return int 0 if sucess 1 if fail, the key or the field is already taken
+ */
+int hashmapMultiIndexInsert(HashmapMultiIndex* const index, void* const record) {
+    unsigned len;
+    const char* key = index->key(record, &len);
+    const char* field = (const char*)index->field(record);
+    if (hashmapGet(&index->byKey, key, len) || hashmapGet(&index->byField, field, sizeof(unsigned))) {
+        return 1;
+    }
+    if (hashmapPut(&index->byKey, key, len, record)) {
+        return 1;
+    }
+    if (hashmapPut(&index->byField, field, sizeof(unsigned), record)) {
+        hashmapRemove(&index->byKey, key, len);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get a record by its string key
+ *
+ * @param index The container
+ * @param key The string key
+ * @param len The length of the string key
+ * @return void* The record, or NULL if none exists
+ */
+void* hashmapMultiIndexGet(const HashmapMultiIndex* const index, const char* const key, const unsigned len) {
+    return hashmapGet(&index->byKey, key, len);
+}
+
+/**
+ * @brief Get a record by its integer field
+ *
+ * @param index The container
+ * @param field The value of the field
+ * @return void* The record, or NULL if none exists
+ */
+void* hashmapMultiIndexGetByField(const HashmapMultiIndex* const index, const unsigned field) {
+    return hashmapGet(&index->byField, (const char*)&field, sizeof(unsigned));
+}
+
+/**
+ * @brief Removes a record from both indexes
+ *
+ * @param index The container
+ * @param record The record, found in the indexes
+ */
+static void hashmapMultiIndexUnlink(HashmapMultiIndex* const index, void* const record) {
+    unsigned len;
+    const char* key = index->key(record, &len);
+    hashmapRemove(&index->byKey, key, len);
+    hashmapRemove(&index->byField, (const char*)index->field(record), sizeof(unsigned));
+}
+
+/**
+ * @brief Removes a record by its string key
+ *
+ * @param index The container
+ * @param key The string key
+ * @param len The length of the string key
+ * @param outRecord The storage for the removed record, can be NULL
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapMultiIndexRemove(HashmapMultiIndex* const index, const char* const key, const unsigned len, void** const outRecord) {
+    void* record = hashmapGet(&index->byKey, key, len);
+    if (!record) {
+        return 1;
+    }
+    hashmapMultiIndexUnlink(index, record);
+    if (outRecord) {
+        *outRecord = record;
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes a record by its integer field
+ *
+ * @param index The container
+ * @param field The value of the field
+ * @param outRecord The storage for the removed record, can be NULL
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapMultiIndexRemoveByField(HashmapMultiIndex* const index, const unsigned field, void** const outRecord) {
+    void* record = hashmapGet(&index->byField, (const char*)&field, sizeof(unsigned));
+    if (!record) {
+        return 1;
+    }
+    hashmapMultiIndexUnlink(index, record);
+    if (outRecord) {
+        *outRecord = record;
+    }
+    return 0;
+}
+
+/**
+ * @brief Destroy the container, the records are left alone
+ *
+ * @param index The container to destroy
+ */
+void hashmapMultiIndexDestroy(HashmapMultiIndex* const index) {
+    hashmapDestroy(&index->byKey);
+    hashmapDestroy(&index->byField);
+}
+
+/**
+ * @brief Destroy the records and the container itself
+ *
+ * @param index The container to destroy
+ * @param iterator Iterator function that destroy the element, called once per record
+ */
+void hashmapMultiIndexDestroyWithOwnership(HashmapMultiIndex* const index, int (*iterator)(void* const, HashmapElement* const)) {
+    // the field index goes first, its keys point inside the records
+    hashmapDestroy(&index->byField);
+    hashmapDestroyWithOwnership(&index->byKey, iterator);
+}
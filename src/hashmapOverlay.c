@@ -0,0 +1,188 @@
+/**
+ * @file hashmapOverlay.c
+ * @brief Implements a mutable overlay over a shared read-only base hashmap
+ */
+
+#include "../header/hashmapOverlay.h"
+
+#include "../header/hashmapArena.h"
+#include "../header/hashmapHasher.h"
+
+// only its address matters
+const char hashmapOverlayTombstone = 0;
+
+/**
+ * @brief Create an overlay over a base hashmap
+ *
+ * @param base The base, read but never written by the overlay. It must outlive it
+ * @param deltaSize The initial size of the delta. Must be a power of two
+ * @param outOverlay The storage for the created overlay
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapOverlayCreate(const Hashmap* const base, const unsigned deltaSize, HashmapOverlay* const outOverlay) {
+    outOverlay->base = base;
+    outOverlay->size = base->size;
+    if (hashmapCreate(deltaSize, &outOverlay->delta)) {
+        return 1;
+    }
+    // hashed like the base, so a key is hashed once for both
+    return hashmapSetHasher(&outOverlay->delta, base->hasher);
+}
+
+/**
+ * @brief Looks a key up in the base
+ *
+ * @param overlay The overlay
+ * @param hash The hash of the key in the delta
+ * @param key The string key
+ * @param len The length of the string key
+ * @return void* The value in the base, or NULL if none exists
+ */
+static void* hashmapOverlayGetBase(const HashmapOverlay* const overlay, const unsigned hash, const char* const key, const unsigned len) {
+    const Hashmap* base = overlay->base;
+    unsigned baseHash = base->hasher == overlay->delta.hasher ? hash : hashmapHash(base, key, len);
+    return hashmapGetHashed(base, baseHash, key, len);
+}
+
+/**
+ * @brief Put an element into the overlay, hiding the value of the base if any
+ *
+ * @param overlay The overlay
+ * @param key The string key to use, it must outlive the overlay unless the delta owns its keys
+ * @param len The length of the string key
+ * @param value The value to insert, not NULL
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapOverlayPut(HashmapOverlay* const overlay, const char* const key, const unsigned len, void* const value) {
+    unsigned hash = hashmapHash(&overlay->delta, key, len);
+    void* current = hashmapGetHashed(&overlay->delta, hash, key, len);
+    bool visible = current ? current != HASHMAP_OVERLAY_TOMBSTONE : hashmapOverlayGetBase(overlay, hash, key, len) != NULL;
+    if (hashmapPutHashed(&overlay->delta, hash, key, len, value)) {
+        return 1;
+    }
+    overlay->size += !visible;
+    return 0;
+}
+
+/**
+ * @brief Get an element from the overlay, the delta first then the base
+ *
+ * @param overlay The overlay
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return void* The value, or NULL if none exists or the key was removed
+ */
+void* hashmapOverlayGet(const HashmapOverlay* const overlay, const char* const key, const unsigned len) {
+    unsigned hash = hashmapHash(&overlay->delta, key, len);
+    void* value = hashmapGetHashed(&overlay->delta, hash, key, len);
+    if (value) {
+        return value == HASHMAP_OVERLAY_TOMBSTONE ? NULL : value;
+    }
+    return hashmapOverlayGetBase(overlay, hash, key, len);
+}
+
+/**
+ * @brief Removes a key from the overlay. A key of the base stays
+ * in the delta as a tombstone
+ *
+ * @param overlay The overlay
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapOverlayRemove(HashmapOverlay* const overlay, const char* const key, const unsigned len) {
+    unsigned hash = hashmapHash(&overlay->delta, key, len);
+    void* current = hashmapGetHashed(&overlay->delta, hash, key, len);
+    if (current == HASHMAP_OVERLAY_TOMBSTONE) {
+        return 1;
+    }
+    if (!hashmapOverlayGetBase(overlay, hash, key, len)) {
+        if (!current) {
+            return 1;
+        }
+        hashmapRemove(&overlay->delta, key, len);
+    } else if (hashmapPutHashed(&overlay->delta, hash, key, len, HASHMAP_OVERLAY_TOMBSTONE)) {
+        return 1;
+    }
+    overlay->size--;
+    return 0;
+}
+
+/**
+ * @brief Calls a function on every visible element of the overlay, those of
+ * the delta then those of the base it doesn't hide. The elements are read
+ * only, any non 0 return stops the iteration
+ *
+ * @param overlay The overlay
+ * @param f The function, called with the context and an element
+ * @param context The context
+ * @return int 0 if every element was visited 1 if f stopped early
+ */
+int hashmapOverlayApplyIterator(HashmapOverlay* const overlay, int (*f)(void* const, HashmapElement* const), void* const context) {
+    const Hashmap* delta = &overlay->delta;
+    for (unsigned i = 0; i < hashmapSlotCount(delta); i++) {
+        // a copy, so f can't edit the overlay behind its back
+        HashmapElement elem = delta->data[i];
+        if (elem.used && elem.data != HASHMAP_OVERLAY_TOMBSTONE && f(context, &elem)) {
+            return 1;
+        }
+    }
+
+    const Hashmap* base = overlay->base;
+    for (unsigned i = 0; i < hashmapSlotCount(base); i++) {
+        HashmapElement elem = base->data[i];
+        if (!elem.used) {
+            continue;
+        }
+        // a tombstone or a newer value in the delta hides the element
+        if (delta->size && hashmapGetHashed(delta, hashmapHash(delta, elem.key, elem.keyLen), elem.key, elem.keyLen)) {
+            continue;
+        }
+        if (f(context, &elem)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int hashmapOverlayMergeIterator(void* const context, HashmapElement* const elem) {
+    return hashmapPut((Hashmap*)context, elem->key, elem->keyLen, elem->data);
+}
+
+/**
+ * @brief Builds a new base holding the visible elements of the overlay. The
+ * new base owns copies of its keys, so it doesn't depend on the old base or
+ * on the keys put into the delta. The overlay is left as it was
+ *
+ * @param overlay The overlay
+ * @param outBase The storage for the new base
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapOverlayMerge(const HashmapOverlay* const overlay, Hashmap* const outBase) {
+    // large enough for the elements at the load of the old base
+    const Hashmap* base = overlay->base;
+    unsigned tableSize = base->tableSize;
+    while ((double)overlay->size * base->tableSize > (double)(base->size + 1) * tableSize) {
+        tableSize *= 2;
+    }
+    if (hashmapCreate(tableSize, outBase)) {
+        return 1;
+    }
+    int flag = hashmapSetHasher(outBase, base->hasher);
+    flag |= hashmapOwnKeys(outBase);
+    // the iterator only reads the overlay
+    flag = flag || hashmapOverlayApplyIterator((HashmapOverlay*)overlay, hashmapOverlayMergeIterator, outBase);
+    if (flag) {
+        hashmapDestroy(outBase);
+    }
+    return flag;
+}
+
+/**
+ * @brief Destroys the delta of the overlay, the base is left alone
+ *
+ * @param overlay The overlay
+ */
+void hashmapOverlayDestroy(HashmapOverlay* const overlay) {
+    hashmapDestroy(&overlay->delta);
+}
@@ -0,0 +1,288 @@
+/**
+ * @file hashmapSharded.c
+ * @brief Implements a thread safe hashmap split into independently locked shards
+ *
+ * Every shard is a plain Hashmap guarded by its own mutex, so threads working
+ * on keys of different shards never contend and an expand only stalls the
+ * keys of a single shard.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapSharded.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Create a sharded hashmap
+ *
+ * @param shardCount The number of shards, rounded up to a power of two. 0 means one shard per online core
+ * @param initialSize The initial size of each shard. Must be a power of two
+ * @param outHashmap The storage for the created hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapShardedCreate(const unsigned shardCount, const unsigned initialSize, HashmapSharded* const outHashmap) {
+    unsigned wanted = shardCount;
+    if (wanted == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        wanted = (cores > 0) ? (unsigned)cores : 1;
+    }
+
+    // round up to a power of two so the shard can be picked with a shift
+    outHashmap->shardCount = 1;
+    outHashmap->shardBits = 0;
+    while (outHashmap->shardCount < wanted) {
+        outHashmap->shardCount <<= 1;
+        outHashmap->shardBits++;
+    }
+
+    outHashmap->maintainer = NULL;
+    outHashmap->shards = (HashmapShard*)calloc(outHashmap->shardCount, sizeof(HashmapShard));
+    if (!outHashmap->shards) {
+        return 1;
+    }
+
+    for (unsigned i = 0; i < outHashmap->shardCount; i++) {
+        if (hashmapCreate(initialSize, &outHashmap->shards[i].map)) {
+            for (unsigned j = 0; j < i; j++) {
+                pthread_mutex_destroy(&outHashmap->shards[j].lock);
+                hashmapDestroy(&outHashmap->shards[j].map);
+            }
+            free(outHashmap->shards);
+            return 1;
+        }
+        pthread_mutex_init(&outHashmap->shards[i].lock, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gets the shard responsible for a key. The caller must hold its lock to use its map
+ *
+ * @param hashmap The sharded hashmap
+ * @param key The string key
+ * @param len The length of the string key
+ * @return HashmapShard* The shard owning the key
+ */
+HashmapShard* hashmapShardedShardFor(const HashmapSharded* const hashmap, const char* const key, const unsigned len) {
+    if (hashmap->shardBits == 0) {
+        return &hashmap->shards[0];
+    }
+
+    // the shard maps index with the low bits of the mixed hash, so use the top bits of the raw one
+    unsigned shard = hashmapCRC32(key, len) >> (32 - hashmap->shardBits);
+    return &hashmap->shards[shard];
+}
+
+/**
+ * @brief Put an element into the sharded hashmap
+ *
+ * @param hashmap The hashmap to insert into
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param value The value to insert
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapShardedPut(HashmapSharded* const hashmap, const char* const key, const unsigned len, void* const value) {
+    HashmapShard* shard = hashmapShardedShardFor(hashmap, key, len);
+
+    pthread_mutex_lock(&shard->lock);
+    int flag = hashmapPut(&shard->map, key, len, value);
+    pthread_mutex_unlock(&shard->lock);
+
+    return flag;
+}
+
+/**
+ * @brief Get an element from the sharded hashmap
+ *
+ * @param hashmap The hashmap to get from
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return void* The previously set element, or NULL if none exists
+ */
+void* hashmapShardedGet(HashmapSharded* const hashmap, const char* const key, const unsigned len) {
+    HashmapShard* shard = hashmapShardedShardFor(hashmap, key, len);
+
+    pthread_mutex_lock(&shard->lock);
+    void* value = hashmapGet(&shard->map, key, len);
+    pthread_mutex_unlock(&shard->lock);
+
+    return value;
+}
+
+/**
+ * @brief Removes a key from the sharded hashmap
+ *
+ * @param hashmap The hashmap to remove from
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @return int 0, if it found and removed it 1 otherwise
+ */
+int hashmapShardedRemove(HashmapSharded* const hashmap, const char* const key, const unsigned len) {
+    HashmapShard* shard = hashmapShardedShardFor(hashmap, key, len);
+
+    pthread_mutex_lock(&shard->lock);
+    int flag = hashmapRemove(&shard->map, key, len);
+    pthread_mutex_unlock(&shard->lock);
+
+    return flag;
+}
+
+/**
+ * @brief Runs hashmapCompute on a key under the lock of its shard, so the
+ * read-modify-write is atomic with respect to every other operation
+ *
+ * @param hashmap The sharded hashmap
+ * @param key The string key to use
+ * @param len The length of the string key
+ * @param f The function pointer deciding the new value, must not use the sharded hashmap
+ * @param context The context to pass as the first argument to f
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapShardedCompute(HashmapSharded* const hashmap, const char* const key, const unsigned len, HashmapComputeFunction f, void* const context) {
+    HashmapShard* shard = hashmapShardedShardFor(hashmap, key, len);
+
+    pthread_mutex_lock(&shard->lock);
+    int flag = hashmapCompute(&shard->map, key, len, f, context);
+    pthread_mutex_unlock(&shard->lock);
+
+    return flag;
+}
+
+/**
+ * @brief Counts the elements of every shard
+ *
+ * @param hashmap The sharded hashmap
+ * @return unsigned The number of elements
+ */
+unsigned hashmapShardedSize(HashmapSharded* const hashmap) {
+    unsigned size = 0;
+    for (unsigned i = 0; i < hashmap->shardCount; i++) {
+        pthread_mutex_lock(&hashmap->shards[i].lock);
+        size += hashmap->shards[i].map.size;
+        pthread_mutex_unlock(&hashmap->shards[i].lock);
+    }
+    return size;
+}
+
+static void* hashmapShardedMaintain(void* const arg) {
+    HashmapShardedMaintainer* maintainer = (HashmapShardedMaintainer*)arg;
+    HashmapSharded* hashmap = maintainer->hashmap;
+
+    pthread_mutex_lock(&maintainer->lock);
+    while (!maintainer->stop) {
+        pthread_mutex_unlock(&maintainer->lock);
+        for (unsigned i = 0; i < hashmap->shardCount; i++) {
+            // a busy shard is skipped, the foreground never waits in line behind the maintenance
+            HashmapShard* shard = &hashmap->shards[i];
+            if (pthread_mutex_trylock(&shard->lock) == 0) {
+                hashmapMaintain(&shard->map, maintainer->budgetNs);
+                pthread_mutex_unlock(&shard->lock);
+            }
+        }
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += maintainer->intervalMs / 1000;
+        until.tv_nsec += (long)(maintainer->intervalMs % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&maintainer->lock);
+        while (!maintainer->stop && pthread_cond_timedwait(&maintainer->wake, &maintainer->lock, &until) == 0) {
+            // a spurious wakeup, sleep on until the interval ends
+        }
+    }
+    pthread_mutex_unlock(&maintainer->lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts a thread running hashmapMaintain on every shard once per interval
+ *
+ * @param hashmap The sharded hashmap, it must not move while the thread runs
+ * @param intervalMs The time between two visits of the shards, in milliseconds
+ * @param budgetNs The budget of hashmapMaintain on each shard, in nanoseconds
+ * @return int 0 if sucess 1 if fail, or if the thread already runs
+ */
+int hashmapShardedStartMaintenance(HashmapSharded* const hashmap, const unsigned intervalMs, const uint64_t budgetNs) {
+    if (hashmap->maintainer) {
+        return 1;
+    }
+    HashmapShardedMaintainer* maintainer = (HashmapShardedMaintainer*)calloc(1, sizeof(HashmapShardedMaintainer));
+    if (!maintainer) {
+        return 1;
+    }
+    maintainer->intervalMs = intervalMs;
+    maintainer->budgetNs = budgetNs;
+    maintainer->hashmap = hashmap;
+    pthread_mutex_init(&maintainer->lock, NULL);
+    pthread_cond_init(&maintainer->wake, NULL);
+    if (pthread_create(&maintainer->thread, NULL, hashmapShardedMaintain, maintainer)) {
+        pthread_cond_destroy(&maintainer->wake);
+        pthread_mutex_destroy(&maintainer->lock);
+        free(maintainer);
+        return 1;
+    }
+    hashmap->maintainer = maintainer;
+    return 0;
+}
+
+/**
+ * @brief Stops the maintenance thread, if any, and waits for it to exit
+ *
+ * @param hashmap The sharded hashmap
+ */
+void hashmapShardedStopMaintenance(HashmapSharded* const hashmap) {
+    HashmapShardedMaintainer* maintainer = hashmap->maintainer;
+    if (!maintainer) {
+        return;
+    }
+    pthread_mutex_lock(&maintainer->lock);
+    maintainer->stop = true;
+    pthread_cond_signal(&maintainer->wake);
+    pthread_mutex_unlock(&maintainer->lock);
+    pthread_join(maintainer->thread, NULL);
+
+    pthread_cond_destroy(&maintainer->wake);
+    pthread_mutex_destroy(&maintainer->lock);
+    free(maintainer);
+    hashmap->maintainer = NULL;
+}
+
+/**
+ * @brief Destroy the sharded hashmap. No other thread may be using it
+ *
+ * @param hashmap The hashmap to destroy
+ */
+void hashmapShardedDestroy(HashmapSharded* const hashmap) {
+    hashmapShardedStopMaintenance(hashmap);
+    for (unsigned i = 0; i < hashmap->shardCount; i++) {
+        pthread_mutex_destroy(&hashmap->shards[i].lock);
+        hashmapDestroy(&hashmap->shards[i].map);
+    }
+    free(hashmap->shards);
+    memset(hashmap, 0, sizeof(HashmapSharded));
+}
+
+/**
+ * @brief Destroy the elements of every shard and the sharded hashmap itself
+ *
+ * @param hashmap The hashmap to destroy
+ * @param iterator Iterator function that destroy the element
+ */
+void hashmapShardedDestroyWithOwnership(HashmapSharded* const hashmap, int (*iterator)(void* const, HashmapElement* const)) {
+    hashmapShardedStopMaintenance(hashmap);
+    for (unsigned i = 0; i < hashmap->shardCount; i++) {
+        pthread_mutex_destroy(&hashmap->shards[i].lock);
+        hashmapDestroyWithOwnership(&hashmap->shards[i].map, iterator);
+    }
+    free(hashmap->shards);
+    memset(hashmap, 0, sizeof(HashmapSharded));
+}
@@ -0,0 +1,283 @@
+/**
+ * @file hashmapSnapshot.c
+ * @brief Implements full and incremental snapshot files of a hashmap
+ *
+ * Layout, in host byte order: a HashmapSnapshotHeader, then for every stored
+ * range a HashmapSnapshotRange followed by one HashmapSnapshotEntry, the
+ * value bytes and the key bytes per used bucket of the range. A stored range
+ * replaces the whole range when loading, so removed keys disappear too.
+ */
+
+#include "../header/hashmapSnapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASHMAP_SNAPSHOT_MAGIC "HMSNAP01"
+
+typedef struct {
+    char magic[8];
+    unsigned full;
+    unsigned tableSize;
+    unsigned rangeSize;
+    unsigned rangeCount;
+    unsigned sequence;
+    unsigned size;
+} HashmapSnapshotHeader;
+
+typedef struct {
+    unsigned range;
+    unsigned used;
+} HashmapSnapshotRange;
+
+typedef struct {
+    unsigned slot;
+    unsigned keyLen;
+    unsigned valLen;
+} HashmapSnapshotEntry;
+
+// a loaded element: the value bytes followed by the key bytes
+typedef struct {
+    char* block;
+    unsigned keyLen;
+    unsigned valLen;
+} HashmapSnapshotSlot;
+
+typedef struct {
+    unsigned tableSize;
+    unsigned slotCount;  // the buckets and the stash
+    unsigned sequence;
+    HashmapSnapshotSlot* slots;
+} HashmapSnapshotState;
+
+static int hashmapSnapshotWriteRange(const Hashmap* const hashmap, FILE* const file, const unsigned range, HashmapValueSizer sizer, void* const context) {
+    unsigned first = range * HASHMAP_DIRTY_RANGE;
+    unsigned last = first + HASHMAP_DIRTY_RANGE;
+    if (last > hashmapSlotCount(hashmap)) {
+        last = hashmapSlotCount(hashmap);
+    }
+
+    HashmapSnapshotRange header = {.range = range, .used = 0};
+    for (unsigned i = first; i < last; i++) {
+        header.used += hashmap->data[i].used;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return 1;
+    }
+
+    for (unsigned i = first; i < last; i++) {
+        const HashmapElement* elem = &hashmap->data[i];
+        if (!elem->used) {
+            continue;
+        }
+        HashmapSnapshotEntry entry = {.slot = i - first, .keyLen = elem->keyLen, .valLen = sizer(elem->data, context)};
+        if (fwrite(&entry, sizeof(entry), 1, file) != 1 ||
+            fwrite(elem->data, 1, entry.valLen, file) != entry.valLen ||
+            fwrite(elem->key, 1, entry.keyLen, file) != entry.keyLen) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a snapshot of the hashmap and starts a new checkpoint
+ *
+ * @param hashmap The hashmap to snapshot
+ * @param path The path of the snapshot file, replaced atomically
+ * @param full Write every range, otherwise only the ones changed since the last
+ * checkpoint, which needs hashmapTrackDirty to have been called
+ * @param sizer Returns the size of each value
+ * @param context The context to pass as the last argument to sizer
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapSnapshotWrite(Hashmap* const hashmap, const char* const path, const bool full, HashmapValueSizer sizer, void* const context) {
+    if (!full && !hashmap->dirty) {
+        return 1;
+    }
+
+    unsigned totalRanges = (hashmapSlotCount(hashmap) + HASHMAP_DIRTY_RANGE - 1) / HASHMAP_DIRTY_RANGE;
+    HashmapSnapshotHeader header;
+    memcpy(header.magic, HASHMAP_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.full = full;
+    header.tableSize = hashmap->tableSize;
+    header.rangeSize = HASHMAP_DIRTY_RANGE;
+    header.rangeCount = 0;
+    header.sequence = hashmap->dirty ? hashmap->dirty->checkpoints + 1 : 0;
+    header.size = hashmap->size;
+    for (unsigned r = 0; r < totalRanges; r++) {
+        header.rangeCount += full || hashmapIsRangeDirty(hashmap, r);
+    }
+
+    // write next to the target and rename, so a crash never leaves half a file
+    size_t pathLen = strlen(path);
+    char* tmpPath = (char*)malloc(pathLen + 5);
+    if (!tmpPath) {
+        return 1;
+    }
+    memcpy(tmpPath, path, pathLen);
+    memcpy(tmpPath + pathLen, ".tmp", 5);
+
+    FILE* file = fopen(tmpPath, "wb");
+    if (!file) {
+        free(tmpPath);
+        return 1;
+    }
+
+    int flag = fwrite(&header, sizeof(header), 1, file) != 1;
+    for (unsigned r = 0; r < totalRanges && !flag; r++) {
+        if (full || hashmapIsRangeDirty(hashmap, r)) {
+            flag = hashmapSnapshotWriteRange(hashmap, file, r, sizer, context);
+        }
+    }
+    flag |= fclose(file) != 0;
+    if (!flag) {
+        flag = rename(tmpPath, path) != 0;
+    }
+    if (flag) {
+        remove(tmpPath);
+    }
+    free(tmpPath);
+
+    if (!flag && hashmap->dirty) {
+        hashmap->dirty->checkpoints = header.sequence;
+        hashmapClearDirty(hashmap);
+    }
+    return flag;
+}
+
+static void hashmapSnapshotClearSlots(HashmapSnapshotState* const state, const unsigned first, const unsigned last) {
+    for (unsigned i = first; i < last; i++) {
+        free(state->slots[i].block);
+        state->slots[i].block = NULL;
+    }
+}
+
+static int hashmapSnapshotReadRange(HashmapSnapshotState* const state, FILE* const file) {
+    HashmapSnapshotRange range;
+    if (fread(&range, sizeof(range), 1, file) != 1) {
+        return 1;
+    }
+    unsigned first = range.range * HASHMAP_DIRTY_RANGE;
+    if (first >= state->slotCount || range.used > HASHMAP_DIRTY_RANGE) {
+        return 1;
+    }
+    unsigned last = first + HASHMAP_DIRTY_RANGE;
+    if (last > state->slotCount) {
+        last = state->slotCount;
+    }
+
+    hashmapSnapshotClearSlots(state, first, last);
+    for (unsigned i = 0; i < range.used; i++) {
+        HashmapSnapshotEntry entry;
+        if (fread(&entry, sizeof(entry), 1, file) != 1 || first + entry.slot >= last) {
+            return 1;
+        }
+
+        HashmapSnapshotSlot* slot = &state->slots[first + entry.slot];
+        free(slot->block);
+        slot->block = (char*)malloc((size_t)entry.valLen + entry.keyLen + 1);
+        if (!slot->block) {
+            return 1;
+        }
+        slot->keyLen = entry.keyLen;
+        slot->valLen = entry.valLen;
+        if (fread(slot->block, 1, (size_t)entry.valLen + entry.keyLen, file) != (size_t)entry.valLen + entry.keyLen) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int hashmapSnapshotApplyFile(HashmapSnapshotState* const state, const char* const path, const bool first) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 1;
+    }
+
+    HashmapSnapshotHeader header;
+    int flag = fread(&header, sizeof(header), 1, file) != 1 ||
+               memcmp(header.magic, HASHMAP_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+               header.rangeSize != HASHMAP_DIRTY_RANGE;
+
+    // the chain has to start with a full snapshot and deltas must follow each other
+    if (!flag && (first ? !header.full : (!header.full && header.sequence != state->sequence + 1))) {
+        flag = 1;
+    }
+
+    // a resized table moved every bucket, its delta covers the whole table
+    if (!flag && (first || header.tableSize != state->tableSize)) {
+        if (state->slots) {
+            hashmapSnapshotClearSlots(state, 0, state->slotCount);
+            free(state->slots);
+        }
+        state->tableSize = header.tableSize;
+        state->slotCount = header.tableSize + HASHMAP_STASH_SIZE;
+        state->slots = (HashmapSnapshotSlot*)calloc(state->slotCount, sizeof(HashmapSnapshotSlot));
+        flag = state->slots == NULL;
+    }
+
+    for (unsigned r = 0; r < header.rangeCount && !flag; r++) {
+        flag = hashmapSnapshotReadRange(state, file);
+    }
+    state->sequence = header.sequence;
+
+    fclose(file);
+    return flag;
+}
+
+/**
+ * @brief Rebuilds a hashmap from a full snapshot followed by its deltas.
+ * The elements own their storage, destroy them with hashmapSnapshotFreeIterator
+ *
+ * @param paths The snapshot files, oldest first
+ * @param count The number of files
+ * @param outHashmap The storage for the loaded hashmap
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapSnapshotLoad(const char* const* const paths, const unsigned count, Hashmap* const outHashmap) {
+    HashmapSnapshotState state = {.tableSize = 0, .slotCount = 0, .sequence = 0, .slots = NULL};
+
+    int flag = count == 0;
+    for (unsigned i = 0; i < count && !flag; i++) {
+        flag = hashmapSnapshotApplyFile(&state, paths[i], i == 0);
+    }
+
+    if (!flag) {
+        flag = hashmapCreate(state.tableSize, outHashmap);
+    }
+    if (!flag) {
+        for (unsigned i = 0; i < state.slotCount && !flag; i++) {
+            HashmapSnapshotSlot* slot = &state.slots[i];
+            if (slot->block) {
+                flag = hashmapPut(outHashmap, slot->block + slot->valLen, slot->keyLen, slot->block);
+                if (!flag) {
+                    slot->block = NULL;  // owned by the hashmap now
+                }
+            }
+        }
+        if (flag) {
+            hashmapDestroyWithOwnership(outHashmap, hashmapSnapshotFreeIterator);
+        }
+    }
+
+    if (state.slots) {
+        hashmapSnapshotClearSlots(&state, 0, state.slotCount);
+        free(state.slots);
+    }
+    return flag;
+}
+
+/**
+ * @brief Iterator that frees the elements of a loaded hashmap
+ *
+ * @param context Not used, compatibility with hashmapApplyIterator
+ * @param elem The element to be destroyed
+ * @return int -1 to remove the element
+ */
+int hashmapSnapshotFreeIterator(void* const context, HashmapElement* const elem) {
+    (void)context;
+    free(elem->data);
+    return -1;
+}
@@ -0,0 +1,349 @@
+/**
+ * @file hashmapSort.c
+ * @brief Implements a parallel dump of the keys of a hashmap in sorted order
+ *
+ * Keys are gathered in parallel, one slice of buckets per thread, next to a
+ * cached copy of 8 of their bytes packed big endian into an integer. The MSD
+ * radix sort then reads the cache instead of chasing the key pointers, and
+ * only reloads it every 8 bytes of depth. The 256 buckets of the first byte
+ * are independent and get sorted by the threads in parallel.
+ *
+ * Keys are ordered like memcmp, a key that is a prefix of another one first.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapSort.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t prefix;
+    const char* key;
+    unsigned len;
+} HashmapSortItem;
+
+typedef struct {
+    const Hashmap* hashmap;
+    unsigned first;
+    unsigned last;
+    unsigned rows;
+    unsigned rowStart;
+    HashmapSortItem* items;
+} HashmapSortSlice;
+
+typedef struct {
+    HashmapSortItem* items;
+    HashmapSortItem* tmp;
+    size_t starts[257];
+    atomic_uint nextBucket;
+} HashmapSortJob;
+
+/**
+ * @brief Packs the 8 key bytes starting at depth big endian, padded with zeros
+ *
+ * @param key The key
+ * @param len The length of the key
+ * @param depth The first byte to pack
+ * @return uint64_t The packed bytes, compare like memcmp
+ */
+static uint64_t hashmapSortPrefix(const char* const key, const unsigned len, const unsigned depth) {
+    if (len >= depth + 8) {
+        uint64_t v;
+        memcpy(&v, key + depth, sizeof(v));
+        return __builtin_bswap64(v);
+    }
+
+    uint64_t v = 0;
+    for (unsigned i = 0; i < 8; i++) {
+        v <<= 8;
+        if (depth + i < len) {
+            v |= (unsigned char)key[depth + i];
+        }
+    }
+    return v;
+}
+
+/**
+ * @brief Compares two keys sharing their first depth bytes
+ *
+ * @param a The first key
+ * @param b The second key
+ * @param depth The number of bytes known to be equal
+ * @return int <0, 0 or >0 like memcmp
+ */
+static int hashmapSortCompare(const HashmapSortItem* const a, const HashmapSortItem* const b, const unsigned depth) {
+    // a smaller cached prefix always means a smaller key, even with padding
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+
+    unsigned from = depth + 8;
+    unsigned restA = a->len > from ? a->len - from : 0;
+    unsigned restB = b->len > from ? b->len - from : 0;
+    unsigned common = restA < restB ? restA : restB;
+    int c = common ? memcmp(a->key + from, b->key + from, common) : 0;
+    if (c) {
+        return c;
+    }
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+static void hashmapSortInsertion(HashmapSortItem* const items, const size_t n, const unsigned depth) {
+    for (size_t i = 1; i < n; i++) {
+        HashmapSortItem item = items[i];
+        size_t j = i;
+        while (j > 0 && hashmapSortCompare(&item, &items[j - 1], depth) < 0) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+/**
+ * @brief Puts first, sorted, the keys whose cached 8 bytes at depth are all
+ * equal and that end inside them, then caches the next 8 bytes of the others
+ *
+ * @param items The keys
+ * @param n The number of keys
+ * @param depth The depth of the cached bytes
+ * @return size_t The number of keys that ended
+ */
+static size_t hashmapSortTail(HashmapSortItem* const items, const size_t n, const unsigned depth) {
+    // keys that end inside the cached bytes are prefixes of the others, so
+    // they go first, shortest first
+    size_t ended = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (items[i].len <= depth + 8) {
+            HashmapSortItem item = items[i];
+            items[i] = items[ended];
+            items[ended++] = item;
+        }
+    }
+    hashmapSortInsertion(items, ended, depth);
+
+    // the rest moves on to the next 8 bytes
+    for (size_t i = ended; i < n; i++) {
+        items[i].prefix = hashmapSortPrefix(items[i].key, items[i].len, depth + 8);
+    }
+    return ended;
+}
+
+/**
+ * @brief Scatters keys by one byte of their cached prefix
+ *
+ * @param items The keys, sorted by the byte on return
+ * @param tmp Scratch space for n keys
+ * @param n The number of keys
+ * @param shift The position of the byte in the prefix
+ * @param starts The storage for the 257 bucket boundaries
+ */
+static void hashmapSortScatter(HashmapSortItem* const items, HashmapSortItem* const tmp, const size_t n, const unsigned shift, size_t* const starts) {
+    size_t counts[256] = {0};
+    for (size_t i = 0; i < n; i++) {
+        counts[(items[i].prefix >> shift) & 0xFF]++;
+    }
+
+    starts[0] = 0;
+    for (unsigned b = 0; b < 256; b++) {
+        starts[b + 1] = starts[b] + counts[b];
+    }
+
+    // a single bucket means the byte doesn't discriminate, nothing to move
+    if (counts[(items[0].prefix >> shift) & 0xFF] == n) {
+        return;
+    }
+
+    size_t pos[256];
+    memcpy(pos, starts, sizeof(pos));
+    for (size_t i = 0; i < n; i++) {
+        tmp[pos[(items[i].prefix >> shift) & 0xFF]++] = items[i];
+    }
+    memcpy(items, tmp, n * sizeof(HashmapSortItem));
+}
+
+/**
+ * @brief MSD radix sort of keys sharing their first depth bytes and byteIndex bytes of the cached prefix.
+ * Only the buckets other than the largest one recurse, they hold at most half
+ * the keys, so the recursion stays logarithmic. The largest bucket, and the
+ * next depth once the cached prefix is used up, are sorted by the loop, however
+ * long a prefix the keys share
+ *
+ * @param items The keys
+ * @param tmp Scratch space for n keys
+ * @param n The number of keys
+ * @param depth The depth of the cached prefix
+ * @param byteIndex The byte of the cached prefix to sort by
+ */
+static void hashmapSortRadix(HashmapSortItem* items, HashmapSortItem* tmp, size_t n, unsigned depth, unsigned byteIndex) {
+    while (n >= 2) {
+        if (byteIndex == 8) {
+            size_t ended = hashmapSortTail(items, n, depth);
+            items += ended;
+            tmp += ended;
+            n -= ended;
+            depth += 8;
+            byteIndex = 0;
+            continue;
+        }
+        if (n < HASHMAP_SORT_INSERTION_THRESHOLD) {
+            hashmapSortInsertion(items, n, depth);
+            return;
+        }
+
+        size_t starts[257];
+        hashmapSortScatter(items, tmp, n, 56 - 8 * byteIndex, starts);
+        unsigned largest = 0;
+        for (unsigned b = 1; b < 256; b++) {
+            if (starts[b + 1] - starts[b] > starts[largest + 1] - starts[largest]) {
+                largest = b;
+            }
+        }
+        for (unsigned b = 0; b < 256; b++) {
+            if (b != largest) {
+                hashmapSortRadix(items + starts[b], tmp + starts[b], starts[b + 1] - starts[b], depth, byteIndex + 1);
+            }
+        }
+        items += starts[largest];
+        tmp += starts[largest];
+        n = starts[largest + 1] - starts[largest];
+        byteIndex++;
+    }
+}
+
+static void* hashmapSortCount(void* const arg) {
+    HashmapSortSlice* slice = (HashmapSortSlice*)arg;
+    const HashmapElement* data = slice->hashmap->data;
+    for (unsigned i = slice->first; i < slice->last; i++) {
+        slice->rows += data[i].used;
+    }
+    return NULL;
+}
+
+static void* hashmapSortGather(void* const arg) {
+    HashmapSortSlice* slice = (HashmapSortSlice*)arg;
+    const HashmapElement* data = slice->hashmap->data;
+    HashmapSortItem* item = slice->items + slice->rowStart;
+    for (unsigned i = slice->first; i < slice->last; i++) {
+        if (data[i].used) {
+            item->key = data[i].key;
+            item->len = data[i].keyLen;
+            item->prefix = hashmapSortPrefix(data[i].key, data[i].keyLen, 0);
+            item++;
+        }
+    }
+    return NULL;
+}
+
+static void* hashmapSortWorker(void* const arg) {
+    HashmapSortJob* job = (HashmapSortJob*)arg;
+    unsigned b;
+    while ((b = atomic_fetch_add(&job->nextBucket, 1)) < 256) {
+        size_t start = job->starts[b];
+        hashmapSortRadix(job->items + start, job->tmp + start, job->starts[b + 1] - start, 0, 1);
+    }
+    return NULL;
+}
+
+static void hashmapSortRun(void* const args, const size_t argSize, const unsigned count, void* (*task)(void*)) {
+    pthread_t* threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    unsigned started = 0;
+    if (threads) {
+        for (; started + 1 < count; started++) {
+            if (pthread_create(&threads[started], NULL, task, (char*)args + started * argSize)) {
+                break;
+            }
+        }
+    }
+
+    // whatever couldn't get a thread runs here
+    for (unsigned i = started; i < count; i++) {
+        task((char*)args + i * argSize);
+    }
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * @brief Lists every key of the hashmap in sorted order
+ *
+ * @param hashmap The hashmap. It must not change during the call
+ * @param threads The number of threads to use, 0 for one per online core
+ * @param outKeys The sorted keys, pointing to the keys of the hashmap. Free it with free
+ * @param outCount The number of keys
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapSortedKeys(const Hashmap* const hashmap, const unsigned threads, HashmapKeyRef** const outKeys, unsigned* const outCount) {
+    unsigned sliceCount = threads;
+    if (sliceCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        sliceCount = (cores > 0) ? (unsigned)cores : 1;
+    }
+    if (sliceCount > hashmap->tableSize) {
+        sliceCount = hashmap->tableSize;
+    }
+
+    HashmapSortSlice* slices = (HashmapSortSlice*)calloc(sliceCount, sizeof(HashmapSortSlice));
+    if (!slices) {
+        return 1;
+    }
+    unsigned step = hashmap->tableSize / sliceCount;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].hashmap = hashmap;
+        slices[i].first = i * step;
+        slices[i].last = (i + 1 == sliceCount) ? hashmapSlotCount(hashmap) : (i + 1) * step;
+    }
+    hashmapSortRun(slices, sizeof(HashmapSortSlice), sliceCount, hashmapSortCount);
+
+    unsigned rows = 0;
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].rowStart = rows;
+        rows += slices[i].rows;
+    }
+
+    HashmapSortItem* items = (HashmapSortItem*)malloc(((size_t)rows + 1) * sizeof(HashmapSortItem));
+    HashmapSortItem* tmp = (HashmapSortItem*)malloc(((size_t)rows + 1) * sizeof(HashmapSortItem));
+    HashmapKeyRef* keys = (HashmapKeyRef*)malloc(((size_t)rows + 1) * sizeof(HashmapKeyRef));
+    if (!items || !tmp || !keys) {
+        free(items);
+        free(tmp);
+        free(keys);
+        free(slices);
+        return 1;
+    }
+    for (unsigned i = 0; i < sliceCount; i++) {
+        slices[i].items = items;
+    }
+    hashmapSortRun(slices, sizeof(HashmapSortSlice), sliceCount, hashmapSortGather);
+    free(slices);
+
+    if (rows >= HASHMAP_SORT_INSERTION_THRESHOLD) {
+        // split on the first byte here, then sort the buckets in parallel
+        HashmapSortJob job = {.items = items, .tmp = tmp};
+        atomic_init(&job.nextBucket, 0);
+        hashmapSortScatter(items, tmp, rows, 56, job.starts);
+
+        // every thread shares the job and pulls buckets until none are left
+        hashmapSortRun(&job, 0, sliceCount, hashmapSortWorker);
+    } else {
+        hashmapSortInsertion(items, rows, 0);
+    }
+
+    for (unsigned i = 0; i < rows; i++) {
+        keys[i].key = items[i].key;
+        keys[i].len = items[i].len;
+    }
+    free(items);
+    free(tmp);
+
+    *outKeys = keys;
+    *outCount = rows;
+    return 0;
+}
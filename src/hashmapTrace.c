@@ -0,0 +1,194 @@
+/**
+ * @file hashmapTrace.c
+ * @brief Implements a binary trace of the operations done on hashmaps
+ *
+ * Each record is assembled on the stack and written with a single fwrite,
+ * which holds the stream lock, so records from several threads never
+ * interleave. The trace must be opened and closed while no hashmap is used.
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/hashmapTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FILE* hashmapTraceFile = NULL;
+static bool hashmapTraceHashed = false;
+static _Thread_local unsigned hashmapTraceSuppressed = 0;
+
+/**
+ * @brief Starts tracing every hashmap operation to a file
+ *
+ * @param path The path of the trace file, truncated
+ * @param hashKeys Store a hash of each key instead of its bytes
+ * @return int 0 if sucess 1 if fail
+ */
+int hashmapTraceOpen(const char* const path, const bool hashKeys) {
+    if (hashmapTraceFile) {
+        return 1;
+    }
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 1;
+    }
+    setvbuf(file, NULL, _IOFBF, HASHMAP_TRACE_BUFFER);
+
+    HashmapTraceHeader header;
+    memcpy(header.magic, HASHMAP_TRACE_MAGIC, sizeof(header.magic));
+    header.hashedKeys = hashKeys;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return 1;
+    }
+
+    hashmapTraceHashed = hashKeys;
+    hashmapTraceFile = file;
+    return 0;
+}
+
+/**
+ * @brief Stops tracing and flushes the trace file
+ */
+void hashmapTraceClose(void) {
+    if (hashmapTraceFile) {
+        fclose(hashmapTraceFile);
+        hashmapTraceFile = NULL;
+    }
+}
+
+/**
+ * @brief Feeds more key bytes to a hash, hashing a key piece by piece gives the hash of the whole
+ *
+ * @param hash The hash of the bytes before
+ * @param bytes The bytes
+ * @param len The number of bytes
+ * @return uint64_t The hash including the bytes
+ */
+static uint64_t hashmapTraceKeyHashMore(uint64_t hash, const char* const bytes, const unsigned len) {
+    for (unsigned i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hashes a key for a trace that keeps keys private
+ *
+ * @param key The key
+ * @param len The length of the key
+ * @return uint64_t The 64 bit FNV-1a hash of the key
+ */
+uint64_t hashmapTraceKeyHash(const char* const key, const unsigned len) {
+    return hashmapTraceKeyHashMore(14695981039346656037ULL, key, len);
+}
+
+static HashmapTraceRecord hashmapTraceRecordOf(const HashmapTraceOp op, const Hashmap* const hashmap, const unsigned len) {
+    HashmapTraceRecord record;
+    record.op = (uint8_t)op;
+    record.map = (uint32_t)(((uint64_t)(uintptr_t)hashmap * 0x9E3779B97F4A7C15ULL) >> 32);
+    record.len = len;
+    return record;
+}
+
+/**
+ * @brief Appends an operation to the trace, if one is open
+ *
+ * @param op The operation
+ * @param hashmap The hashmap it was done on
+ * @param key The key, NULL for an expand
+ * @param len The length of the key, the new table size for an expand
+ */
+void hashmapTraceRecord(const HashmapTraceOp op, const Hashmap* const hashmap, const char* const key, const unsigned len) {
+    if (!hashmapTraceFile || hashmapTraceSuppressed) {
+        return;
+    }
+
+    HashmapTraceRecord record = hashmapTraceRecordOf(op, hashmap, len);
+
+    // small records are written in one piece, big keys after their record
+    char buffer[256];
+    size_t size = sizeof(record);
+    memcpy(buffer, &record, sizeof(record));
+    if (op == HASHMAP_TRACE_EXPAND) {
+        fwrite(buffer, size, 1, hashmapTraceFile);
+    } else if (hashmapTraceHashed) {
+        uint64_t hash = hashmapTraceKeyHash(key, len);
+        memcpy(buffer + size, &hash, sizeof(hash));
+        fwrite(buffer, size + sizeof(hash), 1, hashmapTraceFile);
+    } else if (size + len <= sizeof(buffer)) {
+        if (len) {
+            memcpy(buffer + size, key, len);
+        }
+        fwrite(buffer, size + len, 1, hashmapTraceFile);
+    } else {
+        flockfile(hashmapTraceFile);
+        fwrite(buffer, size, 1, hashmapTraceFile);
+        fwrite(key, 1, len, hashmapTraceFile);
+        funlockfile(hashmapTraceFile);
+    }
+}
+
+/**
+ * @brief Appends an operation on a key given in fragments to the trace, if one is open.
+ * The record is the same as for the assembled key
+ *
+ * @param op The operation
+ * @param hashmap The hashmap it was done on
+ * @param fragments The fragments of the key
+ * @param count The number of fragments
+ */
+void hashmapTraceRecordFragments(const HashmapTraceOp op, const Hashmap* const hashmap, const HashmapKeyFragment* const fragments, const unsigned count) {
+    if (!hashmapTraceFile || hashmapTraceSuppressed) {
+        return;
+    }
+
+    unsigned len = 0;
+    for (unsigned i = 0; i < count; i++) {
+        len += fragments[i].len;
+    }
+    HashmapTraceRecord record = hashmapTraceRecordOf(op, hashmap, len);
+
+    char buffer[256];
+    size_t size = sizeof(record);
+    memcpy(buffer, &record, sizeof(record));
+    if (hashmapTraceHashed) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned i = 0; i < count; i++) {
+            hash = hashmapTraceKeyHashMore(hash, fragments[i].bytes, fragments[i].len);
+        }
+        memcpy(buffer + size, &hash, sizeof(hash));
+        fwrite(buffer, size + sizeof(hash), 1, hashmapTraceFile);
+    } else if (size + len <= sizeof(buffer)) {
+        for (unsigned i = 0; i < count; i++) {
+            if (fragments[i].len) {
+                memcpy(buffer + size, fragments[i].bytes, fragments[i].len);
+                size += fragments[i].len;
+            }
+        }
+        fwrite(buffer, size, 1, hashmapTraceFile);
+    } else {
+        // the lock keeps the fragments together
+        flockfile(hashmapTraceFile);
+        fwrite(buffer, size, 1, hashmapTraceFile);
+        for (unsigned i = 0; i < count; i++) {
+            fwrite(fragments[i].bytes, 1, fragments[i].len, hashmapTraceFile);
+        }
+        funlockfile(hashmapTraceFile);
+    }
+}
+
+/**
+ * @brief Stops or resumes tracing on the calling thread, used around rehashing
+ *
+ * @param on true to stop tracing, false to resume. Calls nest
+ */
+void hashmapTraceSuppress(const bool on) {
+    if (on) {
+        hashmapTraceSuppressed++;
+    } else {
+        hashmapTraceSuppressed--;
+    }
+}
@@ -0,0 +1,253 @@
+/**
+ * @file kvclient.c
+ * @brief Client library for the key-value server with request batching
+ */
+
+#define _GNU_SOURCE
+
+#include "../header/kvclient.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Connects to a server listening on a Unix domain socket
+ *
+ * @param path The path of the server socket
+ * @param outClient The storage for the connected client
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientConnect(const char* const path, KvClient* const outClient) {
+    memset(outClient, 0, sizeof(KvClient));
+    // closeable whatever happens below
+    outClient->fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    outClient->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (outClient->fd < 0) {
+        return 1;
+    }
+    if (connect(outClient->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(outClient->fd);
+        outClient->fd = -1;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Queues a request without sending it
+ *
+ * @param client The client
+ * @param op The operation
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @param val The value bytes, may be NULL if valLen is 0
+ * @param valLen The length of the value
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueue(KvClient* const client, const KvOp op, const char* const key, const unsigned keyLen, const char* const val, const unsigned valLen) {
+    if (keyLen > KV_MAX_PAYLOAD || valLen > KV_MAX_PAYLOAD) {
+        return 1;
+    }
+
+    // flush big batches early so the buffer doesn't grow without bounds
+    if (client->out.len >= KV_CLIENT_AUTOFLUSH_BYTES && kvClientFlush(client)) {
+        return 1;
+    }
+
+    if (kvBufferReserve(&client->out, KV_REQUEST_HEADER_SIZE + keyLen + valLen)) {
+        return 1;
+    }
+
+    KvRequestHeader header = {.op = (uint8_t)op, .keyLen = keyLen, .valLen = valLen};
+    kvEncodeRequestHeader(client->out.data + client->out.len, &header);
+    client->out.len += KV_REQUEST_HEADER_SIZE;
+    if (keyLen) {
+        kvBufferAppend(&client->out, key, keyLen);
+    }
+    if (valLen) {
+        kvBufferAppend(&client->out, val, valLen);
+    }
+
+    client->pending++;
+    return 0;
+}
+
+/**
+ * @brief Queues a get request
+ *
+ * @param client The client
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueueGet(KvClient* const client, const char* const key, const unsigned keyLen) {
+    return kvClientQueue(client, KV_OP_GET, key, keyLen, NULL, 0);
+}
+
+/**
+ * @brief Queues a put request
+ *
+ * @param client The client
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @param val The value bytes
+ * @param valLen The length of the value
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueuePut(KvClient* const client, const char* const key, const unsigned keyLen, const char* const val, const unsigned valLen) {
+    return kvClientQueue(client, KV_OP_PUT, key, keyLen, val, valLen);
+}
+
+/**
+ * @brief Queues a remove request
+ *
+ * @param client The client
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueueRemove(KvClient* const client, const char* const key, const unsigned keyLen) {
+    return kvClientQueue(client, KV_OP_REMOVE, key, keyLen, NULL, 0);
+}
+
+/**
+ * @brief Queues a scan request for every key starting with a prefix
+ *
+ * @param client The client
+ * @param prefix The key prefix, an empty prefix matches every key
+ * @param prefixLen The length of the prefix
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueueScan(KvClient* const client, const char* const prefix, const unsigned prefixLen) {
+    return kvClientQueue(client, KV_OP_SCAN, prefix, prefixLen, NULL, 0);
+}
+
+/**
+ * @brief Queues a scan request for one slice of the store. The response
+ * payload starts with the cursor of the next slice, 0 once the scan is done,
+ * and the scan entries follow it
+ *
+ * @param client The client
+ * @param prefix The key prefix, an empty prefix matches every key
+ * @param prefixLen The length of the prefix
+ * @param cursor 0 to start a scan, otherwise the cursor of the previous response
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueueScanStep(KvClient* const client, const char* const prefix, const unsigned prefixLen, const uint64_t cursor) {
+    return kvClientQueue(client, KV_OP_SCAN, prefix, prefixLen, (const char*)&cursor, sizeof(uint64_t));
+}
+
+/**
+ * @brief Queues a request for the server statistics, answered as "name:value" lines
+ *
+ * @param client The client
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientQueueStats(KvClient* const client) {
+    return kvClientQueue(client, KV_OP_STATS, NULL, 0, NULL, 0);
+}
+
+/**
+ * @brief Sends every queued request in as few writes as possible
+ *
+ * @param client The client
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientFlush(KvClient* const client) {
+    size_t sent = 0;
+    while (sent < client->out.len) {
+        ssize_t n = write(client->fd, client->out.data + sent, client->out.len - sent);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        sent += (size_t)n;
+    }
+    client->out.len = 0;
+    return 0;
+}
+
+/**
+ * @brief Reads the response of the oldest request still pending.
+ * Queued requests are flushed first if needed
+ *
+ * @param client The client
+ * @param outResponse The response. Its payload is valid until the next call
+ * @return int 0 if sucess 1 if fail
+ */
+int kvClientRead(KvClient* const client, KvResponse* const outResponse) {
+    if (!client->pending) {
+        return 1;
+    }
+    if (client->out.len && kvClientFlush(client)) {
+        return 1;
+    }
+
+    KvResponseHeader header;
+    size_t needed = KV_RESPONSE_HEADER_SIZE;
+    while (1) {
+        size_t available = client->in.len - client->inPos;
+        if (available >= KV_RESPONSE_HEADER_SIZE) {
+            kvDecodeResponseHeader(client->in.data + client->inPos, &header);
+            needed = KV_RESPONSE_HEADER_SIZE + (size_t)header.len;
+            if (available >= needed) {
+                break;
+            }
+        }
+
+        // drop the responses already handed out before reading more
+        kvBufferConsume(&client->in, client->inPos);
+        client->inPos = 0;
+
+        // read as much as is available, the server batches responses
+        if (kvBufferReserve(&client->in, needed > 65536 ? needed - client->in.len : 65536)) {
+            return 1;
+        }
+        ssize_t n = read(client->fd, client->in.data + client->in.len, client->in.cap - client->in.len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        client->in.len += (size_t)n;
+    }
+
+    outResponse->status = (KvStatus)header.status;
+    outResponse->payload = client->in.data + client->inPos + KV_RESPONSE_HEADER_SIZE;
+    outResponse->len = header.len;
+    client->inPos += needed;
+    client->pending--;
+    return 0;
+}
+
+/**
+ * @brief Closes the connection and frees the client buffers
+ *
+ * @param client The client
+ */
+void kvClientClose(KvClient* const client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    kvBufferFree(&client->out);
+    kvBufferFree(&client->in);
+    client->fd = -1;
+    client->inPos = 0;
+    client->pending = 0;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file kvproto.c
+ * @brief Binary wire protocol shared by the key-value server and its client library
+ */
+
+#include "../header/kvproto.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Serializes a request header
+ *
+ * @param out The output buffer, at least KV_REQUEST_HEADER_SIZE bytes
+ * @param header The header to serialize
+ */
+void kvEncodeRequestHeader(char* const out, const KvRequestHeader* const header) {
+    out[0] = (char)header->op;
+    memcpy(out + 1, &header->keyLen, sizeof(uint32_t));
+    memcpy(out + 5, &header->valLen, sizeof(uint32_t));
+}
+
+/**
+ * @brief Deserializes a request header
+ *
+ * @param in The input buffer, at least KV_REQUEST_HEADER_SIZE bytes
+ * @param outHeader The decoded header
+ */
+void kvDecodeRequestHeader(const char* const in, KvRequestHeader* const outHeader) {
+    outHeader->op = (uint8_t)in[0];
+    memcpy(&outHeader->keyLen, in + 1, sizeof(uint32_t));
+    memcpy(&outHeader->valLen, in + 5, sizeof(uint32_t));
+}
+
+/**
+ * @brief Serializes a response header
+ *
+ * @param out The output buffer, at least KV_RESPONSE_HEADER_SIZE bytes
+ * @param header The header to serialize
+ */
+void kvEncodeResponseHeader(char* const out, const KvResponseHeader* const header) {
+    out[0] = (char)header->status;
+    memcpy(out + 1, &header->len, sizeof(uint32_t));
+}
+
+/**
+ * @brief Deserializes a response header
+ *
+ * @param in The input buffer, at least KV_RESPONSE_HEADER_SIZE bytes
+ * @param outHeader The decoded header
+ */
+void kvDecodeResponseHeader(const char* const in, KvResponseHeader* const outHeader) {
+    outHeader->status = (uint8_t)in[0];
+    memcpy(&outHeader->len, in + 1, sizeof(uint32_t));
+}
+
+/**
+ * @brief Appends one record of a replication stream
+ *
+ * @param buffer The buffer holding the stream
+ * @param seq The sequence number of the record
+ * @param op The replicated operation
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @param val The value bytes, may be NULL if valLen is 0
+ * @param valLen The length of the value
+ * @return int 0 if sucess 1 if fail
+ */
+int kvAppendRecord(KvBuffer* const buffer, const uint64_t seq, const KvOp op, const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen) {
+    if (kvBufferReserve(buffer, KV_RECORD_HEADER_SIZE + keyLen + valLen)) {
+        return 1;
+    }
+
+    KvRequestHeader header = {.op = (uint8_t)op, .keyLen = keyLen, .valLen = valLen};
+    kvBufferAppend(buffer, &seq, sizeof(uint64_t));
+    kvEncodeRequestHeader(buffer->data + buffer->len, &header);
+    buffer->len += KV_REQUEST_HEADER_SIZE;
+    if (keyLen) {
+        kvBufferAppend(buffer, key, keyLen);
+    }
+    if (valLen) {
+        kvBufferAppend(buffer, val, valLen);
+    }
+    return 0;
+}
+
+/**
+ * @brief Deserializes the header of a replication record
+ *
+ * @param in The input buffer, at least KV_RECORD_HEADER_SIZE bytes
+ * @param outSeq The sequence number of the record
+ * @param outHeader The encoded request of the record
+ */
+void kvDecodeRecordHeader(const char* const in, uint64_t* const outSeq, KvRequestHeader* const outHeader) {
+    memcpy(outSeq, in, sizeof(uint64_t));
+    kvDecodeRequestHeader(in + sizeof(uint64_t), outHeader);
+}
+
+/**
+ * @brief Appends one key-value entry of a scan payload
+ *
+ * @param buffer The buffer holding the payload
+ * @param key The key of the entry
+ * @param keyLen The length of the key
+ * @param val The value of the entry
+ * @param valLen The length of the value
+ * @return int 0 if sucess 1 if fail
+ */
+int kvAppendScanEntry(KvBuffer* const buffer, const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen) {
+    if (kvBufferReserve(buffer, 2 * sizeof(uint32_t) + keyLen + valLen)) {
+        return 1;
+    }
+    kvBufferAppend(buffer, &keyLen, sizeof(uint32_t));
+    kvBufferAppend(buffer, &valLen, sizeof(uint32_t));
+    kvBufferAppend(buffer, key, keyLen);
+    kvBufferAppend(buffer, val, valLen);
+    return 0;
+}
+
+/**
+ * @brief Reads the next key-value entry of a scan payload
+ *
+ * @param payload The scan payload
+ * @param len The length of the payload
+ * @param offset The read position, start it at 0. Advanced past the entry
+ * @param outKey The key of the entry, points into the payload
+ * @param outKeyLen The length of the key
+ * @param outVal The value of the entry, points into the payload
+ * @param outValLen The length of the value
+ * @return int 0 if an entry was read 1 if the payload ended or is malformed
+ */
+int kvNextScanEntry(const char* const payload, const uint32_t len, uint32_t* const offset, const char** const outKey, uint32_t* const outKeyLen, const char** const outVal, uint32_t* const outValLen) {
+    if (len - *offset < 2 * sizeof(uint32_t)) {
+        return 1;
+    }
+    memcpy(outKeyLen, payload + *offset, sizeof(uint32_t));
+    memcpy(outValLen, payload + *offset + sizeof(uint32_t), sizeof(uint32_t));
+
+    uint64_t entryLen = 2 * sizeof(uint32_t) + (uint64_t)*outKeyLen + *outValLen;
+    if (len - *offset < entryLen) {
+        return 1;
+    }
+    *outKey = payload + *offset + 2 * sizeof(uint32_t);
+    *outVal = *outKey + *outKeyLen;
+    *offset += (uint32_t)entryLen;
+    return 0;
+}
+
+/**
+ * @brief Makes sure the buffer can take extra bytes without reallocating
+ *
+ * @param buffer The buffer to grow
+ * @param extra The number of bytes that will be appended
+ * @return int 0 if sucess 1 if fail
+ */
+int kvBufferReserve(KvBuffer* const buffer, const size_t extra) {
+    if (buffer->len + extra <= buffer->cap) {
+        return 0;
+    }
+
+    size_t newCap = buffer->cap ? buffer->cap : 4096;
+    while (newCap < buffer->len + extra) {
+        newCap *= 2;
+    }
+
+    char* data = (char*)realloc(buffer->data, newCap);
+    if (!data) {
+        return 1;
+    }
+    buffer->data = data;
+    buffer->cap = newCap;
+    return 0;
+}
+
+/**
+ * @brief Appends bytes to the end of the buffer
+ *
+ * @param buffer The buffer to append to
+ * @param bytes The bytes to append
+ * @param len The number of bytes
+ * @return int 0 if sucess 1 if fail
+ */
+int kvBufferAppend(KvBuffer* const buffer, const void* const bytes, const size_t len) {
+    if (kvBufferReserve(buffer, len)) {
+        return 1;
+    }
+    memcpy(buffer->data + buffer->len, bytes, len);
+    buffer->len += len;
+    return 0;
+}
+
+/**
+ * @brief Drops bytes from the front of the buffer
+ *
+ * @param buffer The buffer to consume from
+ * @param len The number of bytes already handled
+ */
+void kvBufferConsume(KvBuffer* const buffer, const size_t len) {
+    if (len >= buffer->len) {
+        buffer->len = 0;
+        return;
+    }
+    memmove(buffer->data, buffer->data + len, buffer->len - len);
+    buffer->len -= len;
+}
+
+/**
+ * @brief Frees the buffer storage
+ *
+ * @param buffer The buffer to free
+ */
+void kvBufferFree(KvBuffer* const buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(KvBuffer));
+}
@@ -1,83 +1,12 @@
-#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../header/hashmap.h"
-
-enum dataType { INTEGER,
-                REAL };
-union v {
-    int integer;
-    float real;
-};
-
-struct _var {
-    bool isVar;
-    int type;  // 0: int, 1: n_real
-    union v value;
-    unsigned scope;
-    unsigned addr;
-    char name[32];
-};
-
-struct _proc {
-    bool isVar;
-    int returnType;  // 0: int, 1: n_real
-    unsigned addr;
-    char name[32];
-    int* argsTypes;
-    char** argsNames;
-};
-
-int compilerLogFreeIterator(void* const context, HashmapElement* const elem) {
-    printf("%s has been freed!\n", elem->key);
-    if (*(bool*)elem->data) {
-        struct _var* e = (struct _var* const)elem->data;
-        free(e);
-    } else {
-        struct _proc* e = (struct _proc* const)elem->data;
-        free(e);
-    }
-    return -1;
-}
-int insertVar(Hashmap* symbolTable, char name[], int type, union v value, unsigned scope) {
-    static unsigned addr = UINT_MAX;
-    struct _var* var = (struct _var*)malloc(sizeof(struct _var));
-    if (!var)
-        return 1;
-    var->type = type;
-    var->value = value;
-    var->scope = scope;
-    var->isVar = true;
-    var->addr = ++addr;
-    strcpy(var->name, name);
-
-    return hashmapPut(symbolTable, var->name, strlen(var->name), var);
-}
-
-int insertProc(Hashmap* symbolTable, char name[], int returnType, unsigned addr) {
-    struct _proc* proc = (struct _proc*)malloc(sizeof(struct _proc));
-    proc->returnType = returnType;
-    proc->isVar = false;
-    proc->addr = addr;
-    strcpy(proc->name, name);
-
-    hashmapPut(symbolTable, proc->name, strlen(proc->name), proc);
-}
-
-void showSymbolTableElement(void* const elem) {
-    if (*(bool*)elem) {  // var
-        struct _var* e = (struct _var* const)elem;
-        if (e->type == 0)  // integer
-            printf("Var %s (scope %d, addr %d) value %d\n", e->name, e->scope, e->addr, e->value.integer);
-        else if (e->type == 1)  // real
-            printf("Var %s (scope %d, addr %d) value %f\n", e->name, e->scope, e->addr, e->value.real);
-    } else {  // proc
-        struct _proc* e = (struct _proc* const)elem;
-        printf("Proc %s (return type %s)\n", e->name, ((e->returnType) ? "INT" : "REAL"));
-    }
-}
+#include "../header/hashmapHandle.h"
+#include "../header/hashmapMultiIndex.h"
+#include "../header/hashmapSort.h"
+#include "../header/symbolTable.h"
 
 int main() {
     Hashmap hashmap;
@@ -160,6 +89,58 @@ int main() {
     printf("Found element %s\n", (char* const)element5);
     hashmapDestroyWithOwnership(&hashmapWithOwnership, logFreeIterator);
 
+    /********************************************************************************/
+    // read-only configuration reloaded while readers keep using the old one
+    HashmapHandle config;
+    Hashmap configV1;
+    int version1 = 1, version2 = 2;
+    hashmapCreate(2, &configV1);
+    hashmapPut(&configV1, "version", strlen("version"), &version1);
+    if (hashmapHandleCreate(&config, &configV1, NULL)) {
+        printf("Couldn't create the handle!\n");
+        return 0;
+    }
+    HashmapReadGuard reader = hashmapHandleAcquire(&config);
+    Hashmap configV2;
+    hashmapCreate(2, &configV2);
+    hashmapPut(&configV2, "version", strlen("version"), &version2);
+    hashmapHandleRelease(&config, reader);
+    hashmapHandlePublish(&config, &configV2);
+    reader = hashmapHandleAcquire(&config);
+    printf("Config version %d\n", *(int*)hashmapGet(reader.map, "version", strlen("version")));
+    hashmapHandleRelease(&config, reader);
+    hashmapHandleDestroy(&config);
+
+    /********************************************************************************/
+    // sorted dump of keys sharing a long prefix, the radix sort must not recurse per shared byte
+    const unsigned longKeys = 2000, longKeyLen = 20000;
+    char* longKeyBytes = (char*)malloc((size_t)longKeys * longKeyLen);
+    Hashmap longKeyMap;
+    if (!longKeyBytes || hashmapCreate(2, &longKeyMap)) {
+        printf("Couldn't create the hashmap!\n");
+        return 0;
+    }
+    for (unsigned i = 0; i < longKeys; i++) {
+        char* key = longKeyBytes + (size_t)i * longKeyLen;
+        memset(key, 'a', longKeyLen);
+        snprintf(key + longKeyLen - 8, 8, "%07u", (i * 7919) % longKeys);
+        hashmapPut(&longKeyMap, key, longKeyLen, key);
+    }
+    HashmapKeyRef* sorted;
+    unsigned sortedCount;
+    if (hashmapSortedKeys(&longKeyMap, 0, &sorted, &sortedCount)) {
+        printf("Couldn't sort the keys!\n");
+        return 0;
+    }
+    unsigned misordered = 0;
+    for (unsigned i = 1; i < sortedCount; i++) {
+        misordered += memcmp(sorted[i - 1].key, sorted[i].key, longKeyLen) >= 0;
+    }
+    printf("Sorted %u keys of %u bytes sharing a prefix, %u out of order\n", sortedCount, longKeyLen, misordered);
+    free(sorted);
+    hashmapDestroy(&longKeyMap);
+    free(longKeyBytes);
+
     /********************************************************************************/
     /* SIMULATION OF COMPILER SYMBOL TABLE BEHAVIOUR */
     Hashmap symbolTable;
@@ -169,9 +150,34 @@ int main() {
     insertVar(&symbolTable, "floatVar", REAL, (union v)3.14f, 3);
     insertProc(&symbolTable, "proc", 0, 0);
 
+    showSymbolTableElement(hashmapGet(&symbolTable, "intVar", strlen("intVar")));
+    int increment = 38;
+    hashmapCompute(&symbolTable, "intVar", strlen("intVar"), incrementVar, &increment);
     showSymbolTableElement(hashmapGet(&symbolTable, "intVar", strlen("intVar")));
     showSymbolTableElement(hashmapGet(&symbolTable, "floatVar", strlen("floatVar")));
     showSymbolTableElement(hashmapGet(&symbolTable, "proc", strlen("proc")));
 
     hashmapDestroyWithOwnership(&symbolTable, compilerLogFreeIterator);
+
+    /********************************************************************************/
+    // a code generator resolving the same symbols by name and by address
+    HashmapMultiIndex symbols;
+    if (hashmapMultiIndexCreate(2, symbolName, symbolAddr, &symbols)) {
+        printf("Couldn't create the symbol index!\n");
+        return 0;
+    }
+    hashmapMultiIndexInsert(&symbols, newVar("counter", INTEGER, (union v)0, 0));
+    hashmapMultiIndexInsert(&symbols, newProc("main", 0, 100));
+
+    const struct _var* counter = hashmapMultiIndexGet(&symbols, "counter", strlen("counter"));
+    showSymbolTableElement(hashmapMultiIndexGetByField(&symbols, counter->addr));
+    showSymbolTableElement(hashmapMultiIndexGetByField(&symbols, 100));
+    void* removed;
+    if (!hashmapMultiIndexRemoveByField(&symbols, 100, &removed)) {
+        printf("Removed %s, found by name: %s\n", ((struct _proc*)removed)->name,
+               hashmapMultiIndexGet(&symbols, "main", strlen("main")) ? "yes" : "no");
+        free(removed);
+    }
+
+    hashmapMultiIndexDestroyWithOwnership(&symbols, compilerLogFreeIterator);
 }
\ No newline at end of file
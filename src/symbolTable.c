@@ -0,0 +1,104 @@
+/**
+ * @file symbolTable.c
+ * @brief Implements the compiler symbol table entries stored in a hashmap
+ */
+
+#include "../header/symbolTable.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int compilerLogFreeIterator(void* const context, HashmapElement* const elem) {
+    printf("%s has been freed!\n", elem->key);
+    if (*(bool*)elem->data) {
+        struct _var* e = (struct _var* const)elem->data;
+        free(e);
+    } else {
+        struct _proc* e = (struct _proc* const)elem->data;
+        free(e);
+    }
+    return -1;
+}
+
+struct _var* newVar(char name[], int type, union v value, unsigned scope) {
+    static unsigned addr = UINT_MAX;
+    struct _var* var = (struct _var*)malloc(sizeof(struct _var));
+    if (!var)
+        return NULL;
+    var->type = type;
+    var->value = value;
+    var->scope = scope;
+    var->isVar = true;
+    var->addr = ++addr;
+    strcpy(var->name, name);
+    return var;
+}
+
+struct _proc* newProc(char name[], int returnType, unsigned addr) {
+    struct _proc* proc = (struct _proc*)malloc(sizeof(struct _proc));
+    if (!proc)
+        return NULL;
+    proc->returnType = returnType;
+    proc->isVar = false;
+    proc->addr = addr;
+    strcpy(proc->name, name);
+    return proc;
+}
+
+int insertVar(Hashmap* symbolTable, char name[], int type, union v value, unsigned scope) {
+    struct _var* var = newVar(name, type, value, scope);
+    if (!var)
+        return 1;
+
+    if (hashmapPut(symbolTable, var->name, strlen(var->name), var)) {
+        free(var);
+        return 1;
+    }
+    return 0;
+}
+
+int insertProc(Hashmap* symbolTable, char name[], int returnType, unsigned addr) {
+    struct _proc* proc = newProc(name, returnType, addr);
+    if (!proc)
+        return 1;
+
+    if (hashmapPut(symbolTable, proc->name, strlen(proc->name), proc)) {
+        free(proc);
+        return 1;
+    }
+    return 0;
+}
+
+// the keys of a symbol for a HashmapMultiIndex, vars and procs alike
+const char* symbolName(const void* const symbol, unsigned* const outLen) {
+    const char* name = *(const bool*)symbol ? ((const struct _var*)symbol)->name : ((const struct _proc*)symbol)->name;
+    *outLen = (unsigned)strlen(name);
+    return name;
+}
+
+const unsigned* symbolAddr(const void* const symbol) {
+    return *(const bool*)symbol ? &((const struct _var*)symbol)->addr : &((const struct _proc*)symbol)->addr;
+}
+
+int incrementVar(void* const context, void** const value, const bool found) {
+    if (!found || !*(bool*)*value)
+        return 1;
+    struct _var* var = (struct _var*)*value;
+    var->value.integer += *(int*)context;
+    return 0;
+}
+
+void showSymbolTableElement(void* const elem) {
+    if (*(bool*)elem) {  // var
+        struct _var* e = (struct _var* const)elem;
+        if (e->type == 0)  // integer
+            printf("Var %s (scope %d, addr %d) value %d\n", e->name, e->scope, e->addr, e->value.integer);
+        else if (e->type == 1)  // real
+            printf("Var %s (scope %d, addr %d) value %f\n", e->name, e->scope, e->addr, e->value.real);
+    } else {  // proc
+        struct _proc* e = (struct _proc* const)elem;
+        printf("Proc %s (return type %s)\n", e->name, ((e->returnType) ? "INT" : "REAL"));
+    }
+}
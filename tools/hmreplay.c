@@ -0,0 +1,302 @@
+/**
+ * @file hmreplay.c
+ * @brief Replays an operation trace against a hashmap configuration
+ *
+ * Loads a trace written by a program built with make TRACE=1, then runs its
+ * puts, gets and removes back to back against freshly created hashmaps, one
+ * per hashmap of the trace, and reports the throughput. The expands aren't
+ * replayed, the configuration decides when to expand, but their counts are
+ * compared. Traces holding key hashes are replayed with a synthetic key per
+ * hash, as long as the original key and at least 8 bytes. With -k the
+ * hashmaps own their keys and the size of their key arenas is reported.
+ *
+ * Usage: hmreplay [-h crc32c|fnv1a|x31] [-s initial size] [-f front cache entries] [-a] [-k] <trace>
+ */
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../header/hashmapArena.h"
+#include "../header/hashmapHasher.h"
+#include "../header/hashmapTrace.h"
+
+typedef struct {
+    const char* key;
+    unsigned len;
+    uint32_t map;  // index in the replayed hashmaps
+    uint8_t op;
+} HmReplayOp;
+
+typedef struct {
+    char* file;
+    char* synthetic;  // keys standing for the hashed ones
+    HmReplayOp* ops;
+    unsigned long count;
+    unsigned maps;
+    unsigned long expands;  // in the trace
+} HmReplayTrace;
+
+typedef struct {
+    const HashmapHasher* hasher;
+    unsigned initialSize;
+    unsigned frontEntries;
+    bool autoTune;
+    bool ownKeys;
+} HmReplayConfig;
+
+static double hmNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char* hmReadFile(const char* const path, size_t* const outSize) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    char* buffer = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        rewind(file);
+        buffer = (size > 0) ? (char*)malloc((size_t)size) : NULL;
+        if (buffer && fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+            free(buffer);
+            buffer = NULL;
+        }
+        *outSize = (size_t)size;
+    }
+    fclose(file);
+    return buffer;
+}
+
+/**
+ * @brief Parses a trace into operations on dense hashmap indexes
+ *
+ * @param path The path of the trace
+ * @param trace The parsed trace
+ * @return int 0 if sucess 1 if fail
+ */
+static int hmReplayLoad(const char* const path, HmReplayTrace* const trace) {
+    memset(trace, 0, sizeof(HmReplayTrace));
+    size_t size = 0;
+    trace->file = hmReadFile(path, &size);
+    HashmapTraceHeader header;
+    if (!trace->file || size < sizeof(header)) {
+        return 1;
+    }
+    memcpy(&header, trace->file, sizeof(header));
+    if (memcmp(header.magic, HASHMAP_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        return 1;
+    }
+
+    // a first pass to size everything
+    size_t syntheticBytes = 0;
+    unsigned long count = 0;
+    size_t offset = sizeof(header);
+    HashmapTraceRecord record;
+    while (offset + sizeof(record) <= size) {
+        memcpy(&record, trace->file + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.op == HASHMAP_TRACE_EXPAND) {
+            continue;
+        }
+        offset += header.hashedKeys ? sizeof(uint64_t) : record.len;
+        syntheticBytes += header.hashedKeys ? (record.len > sizeof(uint64_t) ? record.len : sizeof(uint64_t)) : 0;
+        count++;
+    }
+    if (offset != size) {
+        return 1;
+    }
+
+    trace->ops = (HmReplayOp*)malloc((count ? count : 1) * sizeof(HmReplayOp));
+    trace->synthetic = (char*)calloc(syntheticBytes ? syntheticBytes : 1, 1);
+    Hashmap ids;
+    if (!trace->ops || !trace->synthetic || hashmapCreate(16, &ids)) {
+        return 1;
+    }
+
+    char* synthetic = trace->synthetic;
+    offset = sizeof(header);
+    int flag = 0;
+    while (offset < size && !flag) {
+        // the ids are looked up in place, the file outlives the hashmap
+        const char* id = trace->file + offset + offsetof(HashmapTraceRecord, map);
+        memcpy(&record, trace->file + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.op == HASHMAP_TRACE_EXPAND) {
+            trace->expands++;
+            continue;
+        }
+
+        uintptr_t map = (uintptr_t)hashmapGet(&ids, id, sizeof(uint32_t));
+        if (!map) {
+            map = ++trace->maps;
+            flag = hashmapPut(&ids, id, sizeof(uint32_t), (void*)map);
+        }
+
+        HmReplayOp* op = &trace->ops[trace->count++];
+        op->op = record.op;
+        op->map = (uint32_t)(map - 1);
+        if (header.hashedKeys) {
+            op->key = synthetic;
+            op->len = record.len > sizeof(uint64_t) ? record.len : sizeof(uint64_t);
+            memcpy(synthetic, trace->file + offset, sizeof(uint64_t));
+            synthetic += op->len;
+            offset += sizeof(uint64_t);
+        } else {
+            op->key = trace->file + offset;
+            op->len = record.len;
+            offset += record.len;
+        }
+    }
+    hashmapDestroy(&ids);
+    return flag;
+}
+
+static void hmReplayFree(HmReplayTrace* const trace) {
+    free(trace->ops);
+    free(trace->synthetic);
+    free(trace->file);
+}
+
+static const HashmapHasher* hmReplayHasher(const char* const name) {
+    const HashmapHasher* const hashers[] = {&hashmapCRC32Hasher, &hashmapFNV1aHasher, &hashmapX31Hasher};
+    for (unsigned i = 0; i < sizeof(hashers) / sizeof(hashers[0]); i++) {
+        if (strcmp(hashers[i]->name, name) == 0) {
+            return hashers[i];
+        }
+    }
+    return NULL;
+}
+
+static void hmPrintUsage(void) {
+    printf("Usage: hmreplay [-h crc32c|fnv1a|x31] [-s initial size] [-f front cache entries] [-a] [-k] <trace>\n");
+}
+
+int main(int argc, char** argv) {
+    HmReplayConfig config = {.hasher = &hashmapCRC32Hasher, .initialSize = 16, .frontEntries = 0, .autoTune = false, .ownKeys = false};
+    int opt;
+    while ((opt = getopt(argc, argv, "h:s:f:ak")) != -1) {
+        switch (opt) {
+            case 'h':
+                config.hasher = hmReplayHasher(optarg);
+                break;
+            case 's':
+                config.initialSize = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'f': {
+                unsigned long entries = strtoul(optarg, NULL, 10);
+                if (entries > HASHMAP_FRONT_MAX_ENTRIES) {
+                    printf("A front cache has at most %u entries\n", HASHMAP_FRONT_MAX_ENTRIES);
+                    return 1;
+                }
+                config.frontEntries = (unsigned)entries;
+                break;
+            }
+            case 'a':
+                config.autoTune = true;
+                break;
+            case 'k':
+                config.ownKeys = true;
+                break;
+            default:
+                hmPrintUsage();
+                return 1;
+        }
+    }
+    if (optind >= argc || !config.hasher) {
+        hmPrintUsage();
+        return 1;
+    }
+    if (config.frontEntries && config.ownKeys) {
+        printf("A hashmap owning its keys can't have a front cache, -f and -k don't mix\n");
+        return 1;
+    }
+
+    HmReplayTrace trace;
+    if (hmReplayLoad(argv[optind], &trace)) {
+        printf("Couldn't load the trace %s!\n", argv[optind]);
+        hmReplayFree(&trace);
+        return 1;
+    }
+
+    Hashmap* maps = (Hashmap*)calloc(trace.maps ? trace.maps : 1, sizeof(Hashmap));
+    int flag = maps == NULL;
+    unsigned created = 0;
+    for (; created < trace.maps && !flag; created++) {
+        Hashmap* map = &maps[created];
+        flag = hashmapCreate(config.initialSize, map);
+        if (flag) {
+            break;
+        }
+        flag |= hashmapSetHasher(map, config.hasher);
+        flag |= config.autoTune && hashmapAutoTune(map);
+        flag |= config.frontEntries && hashmapEnableFrontCache(map, config.frontEntries);
+        flag |= config.ownKeys && hashmapOwnKeys(map);
+    }
+    if (flag) {
+        printf("Couldn't create the hashmaps, is the initial size a power of two?\n");
+    }
+
+    unsigned long puts = 0, gets = 0, hits = 0, removes = 0;
+    double elapsed = 0;
+    if (!flag) {
+        double start = hmNow();
+        for (unsigned long i = 0; i < trace.count && !flag; i++) {
+            const HmReplayOp* op = &trace.ops[i];
+            Hashmap* map = &maps[op->map];
+            switch (op->op) {
+                case HASHMAP_TRACE_PUT:
+                    flag = hashmapPut(map, op->key, op->len, (void*)op);
+                    puts++;
+                    break;
+                case HASHMAP_TRACE_GET:
+                    hits += hashmapGet(map, op->key, op->len) != NULL;
+                    gets++;
+                    break;
+                case HASHMAP_TRACE_REMOVE:
+                    hashmapRemove(map, op->key, op->len);
+                    removes++;
+                    break;
+            }
+        }
+        elapsed = hmNow() - start;
+    }
+
+    if (!flag) {
+        unsigned long expands = 0;
+        size_t tableBytes = 0, liveKeyBytes = 0, keyBytes = 0;
+        for (unsigned m = 0; m < trace.maps; m++) {
+            if (maps[m].arena) {
+                liveKeyBytes += maps[m].arena->liveBytes;
+                keyBytes += maps[m].arena->reservedBytes;
+            }
+            for (unsigned s = config.initialSize; s < maps[m].tableSize; s *= 2) {
+                expands++;
+            }
+            tableBytes += (size_t)maps[m].tableSize * sizeof(HashmapElement);
+        }
+        printf("%lu operations on %u hashmaps in %.3fs: %.0f operations/s, %.1f ns/operation\n", trace.count, trace.maps,
+               elapsed, (double)trace.count / elapsed, elapsed * 1e9 / (double)(trace.count ? trace.count : 1));
+        printf("%lu puts, %lu gets (%.1f%% hits), %lu removes\n", puts, gets, gets ? 100.0 * (double)hits / (double)gets : 0.0,
+               removes);
+        printf("%lu expands (%lu in the trace), %zu table bytes at the end\n", expands, trace.expands, tableBytes);
+        if (config.ownKeys) {
+            printf("%zu key arena bytes for %zu bytes of live keys\n", keyBytes, liveKeyBytes);
+        }
+    }
+
+    for (unsigned m = 0; m < created; m++) {
+        hashmapDestroy(&maps[m]);
+    }
+    free(maps);
+    hmReplayFree(&trace);
+    return flag;
+}
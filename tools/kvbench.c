@@ -0,0 +1,117 @@
+/**
+ * @file kvbench.c
+ * @brief Load generator for the key-value server
+ *
+ * Every client thread keeps its own connection and sends batches of
+ * pipelined requests, reading all the responses of a batch before sending
+ * the next one.
+ *
+ * Usage: kvbench [socket path] [clients] [requests per client] [pipeline depth] [read percent]
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../header/kvclient.h"
+
+#define KV_BENCH_KEYSPACE 100000
+
+typedef struct {
+    const char* path;
+    unsigned requests;
+    unsigned depth;
+    unsigned readPercent;
+    unsigned seed;
+    unsigned long failures;
+    pthread_t thread;
+} KvBenchClient;
+
+static double kvNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void* kvBenchRun(void* const arg) {
+    KvBenchClient* bench = (KvBenchClient*)arg;
+    KvClient client;
+    if (kvClientConnect(bench->path, &client)) {
+        bench->failures = bench->requests;
+        return NULL;
+    }
+
+    char key[32];
+    char value[64];
+    memset(value, 'v', sizeof(value));
+
+    unsigned done = 0;
+    while (done < bench->requests) {
+        unsigned batch = bench->requests - done < bench->depth ? bench->requests - done : bench->depth;
+        for (unsigned i = 0; i < batch; i++) {
+            unsigned id = (unsigned)rand_r(&bench->seed) % KV_BENCH_KEYSPACE;
+            int keyLen = snprintf(key, sizeof(key), "key:%u", id);
+            if ((unsigned)rand_r(&bench->seed) % 100 < bench->readPercent) {
+                kvClientQueueGet(&client, key, (unsigned)keyLen);
+            } else {
+                kvClientQueuePut(&client, key, (unsigned)keyLen, value, sizeof(value));
+            }
+        }
+
+        for (unsigned i = 0; i < batch; i++) {
+            KvResponse response;
+            if (kvClientRead(&client, &response) || response.status == KV_STATUS_ERROR) {
+                bench->failures++;
+            }
+        }
+        done += batch;
+    }
+
+    kvClientClose(&client);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    const char* path = (argc > 1) ? argv[1] : KV_DEFAULT_SOCKET;
+    unsigned clients = (argc > 2) ? (unsigned)strtoul(argv[2], NULL, 10) : 4;
+    unsigned requests = (argc > 3) ? (unsigned)strtoul(argv[3], NULL, 10) : 1000000;
+    unsigned depth = (argc > 4) ? (unsigned)strtoul(argv[4], NULL, 10) : 64;
+    unsigned readPercent = (argc > 5) ? (unsigned)strtoul(argv[5], NULL, 10) : 80;
+    if (clients == 0 || depth == 0) {
+        printf("Usage: kvbench [socket path] [clients] [requests per client] [pipeline depth] [read percent]\n");
+        return 1;
+    }
+
+    KvBenchClient* benches = (KvBenchClient*)calloc(clients, sizeof(KvBenchClient));
+    if (!benches) {
+        return 1;
+    }
+
+    double start = kvNow();
+    for (unsigned i = 0; i < clients; i++) {
+        benches[i].path = path;
+        benches[i].requests = requests;
+        benches[i].depth = depth;
+        benches[i].readPercent = readPercent;
+        benches[i].seed = i + 1;
+        pthread_create(&benches[i].thread, NULL, kvBenchRun, &benches[i]);
+    }
+
+    unsigned long failures = 0;
+    for (unsigned i = 0; i < clients; i++) {
+        pthread_join(benches[i].thread, NULL);
+        failures += benches[i].failures;
+    }
+    double elapsed = kvNow() - start;
+
+    double total = (double)clients * requests;
+    printf("%u clients, depth %u, %u%% reads: %.0f requests in %.3fs (%.0f req/s), %lu failures\n",
+           clients, depth, readPercent, total, elapsed, total / elapsed, failures);
+
+    free(benches);
+    return failures != 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file kvcli.c
+ * @brief Command line client for the key-value server
+ *
+ * Usage: kvcli <socket path> get <key> | put <key> <value> | remove <key> | scan [prefix] | stats
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../header/kvclient.h"
+
+static void kvPrintUsage(void) {
+    printf("Usage: kvcli <socket path> get <key> | put <key> <value> | remove <key> | scan [prefix] | stats\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        kvPrintUsage();
+        return 1;
+    }
+
+    const char* command = argv[2];
+    const char* key = (argc > 3) ? argv[3] : "";
+    KvOp op;
+    if (!strcmp(command, "get") && argc == 4) {
+        op = KV_OP_GET;
+    } else if (!strcmp(command, "put") && argc == 5) {
+        op = KV_OP_PUT;
+    } else if (!strcmp(command, "remove") && argc == 4) {
+        op = KV_OP_REMOVE;
+    } else if (!strcmp(command, "scan") && argc <= 4) {
+        op = KV_OP_SCAN;
+    } else if (!strcmp(command, "stats") && argc == 3) {
+        op = KV_OP_STATS;
+    } else {
+        kvPrintUsage();
+        return 1;
+    }
+
+    KvClient client;
+    if (kvClientConnect(argv[1], &client)) {
+        printf("Couldn't connect to %s!\n", argv[1]);
+        return 1;
+    }
+
+    // walk the store a slice at a time so the server never stalls on a big scan
+    if (op == KV_OP_SCAN) {
+        uint64_t cursor = 0;
+        do {
+            KvResponse response;
+            if (kvClientQueueScanStep(&client, key, (unsigned)strlen(key), cursor) ||
+                kvClientRead(&client, &response) ||
+                response.status != KV_STATUS_OK || response.len < sizeof(uint64_t)) {
+                printf("Request failed!\n");
+                kvClientClose(&client);
+                return 1;
+            }
+            memcpy(&cursor, response.payload, sizeof(uint64_t));
+
+            uint32_t offset = sizeof(uint64_t);
+            const char* entryKey;
+            const char* entryVal;
+            uint32_t keyLen, valLen;
+            while (!kvNextScanEntry(response.payload, response.len, &offset, &entryKey, &keyLen, &entryVal, &valLen)) {
+                printf("%.*s = %.*s\n", (int)keyLen, entryKey, (int)valLen, entryVal);
+            }
+        } while (cursor);
+
+        kvClientClose(&client);
+        return 0;
+    }
+
+    const char* val = (op == KV_OP_PUT) ? argv[4] : NULL;
+    KvResponse response;
+    if (kvClientQueue(&client, op, key, (unsigned)strlen(key), val, val ? (unsigned)strlen(val) : 0) ||
+        kvClientRead(&client, &response)) {
+        printf("Request failed!\n");
+        kvClientClose(&client);
+        return 1;
+    }
+
+    if (response.status == KV_STATUS_NOT_FOUND) {
+        printf("(not found)\n");
+    } else if (response.status != KV_STATUS_OK) {
+        printf("(error)\n");
+    } else if (op == KV_OP_GET || op == KV_OP_STATS) {
+        printf("%.*s%s", (int)response.len, response.payload, op == KV_OP_GET ? "\n" : "");
+    } else {
+        printf("OK\n");
+    }
+
+    int status = response.status == KV_STATUS_ERROR;
+    kvClientClose(&client);
+    return status;
+}
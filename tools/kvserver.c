@@ -0,0 +1,1080 @@
+/**
+ * @file kvserver.c
+ * @brief Key-value server daemon on a Unix domain socket
+ *
+ * Every worker thread runs its own epoll loop and accepts connections from the
+ * shared listening socket. All the complete requests in a read are executed
+ * back to back (pipelining) and their responses are sent with a single write
+ * (batching). The data lives in a sharded hashmap with one shard per core.
+ *
+ * A server started with -f follows another one: it bootstraps from a snapshot
+ * streamed by the primary, then applies its change log in batches and only
+ * serves reads. See kvproto.h for the replication stream.
+ *
+ * A server built with make TRACE=1 records the operations on its shards to
+ * the trace given with -t, or with -T to keep only key hashes, for hmreplay.
+ *
+ * With -m a maintenance thread grows the shards ahead of the puts, spending
+ * at most the given microseconds on a shard every KV_MAINTAIN_INTERVAL_MS.
+ * Either way a shard halves once deletes leave it below KV_SHRINK_LOW_WATER.
+ *
+ * Usage: kvserver [-w worker threads] [-f primary socket path] [-t|-T trace path] [-m maintenance budget us] [socket path]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../header/hashmapSharded.h"
+#include "../header/hashmapTrace.h"
+#include "../header/kvclient.h"
+#include "../header/kvproto.h"
+
+#define KV_MAX_EVENTS 64
+#define KV_READ_CHUNK 65536
+#define KV_FOLLOWER_MAX_BACKLOG (256u * 1024u * 1024u)
+// time between two visits of the shards by the maintenance thread
+#define KV_MAINTAIN_INTERVAL_MS 100
+// load factor under which the deletes shrink a shard
+#define KV_SHRINK_LOW_WATER 0.1f
+
+// entries own both their key and value, the hashmap key points into the entry
+typedef struct {
+    uint32_t keyLen;
+    uint32_t valLen;
+    char bytes[];
+} KvEntry;
+
+typedef struct KvConnection {
+    int fd;
+    int epfd;
+    bool wantWrite;
+    bool isFollower;
+    pthread_mutex_t lock;  // guards out once other workers stream records to it
+    uint64_t ackedSeq;
+    KvBuffer in;
+    KvBuffer out;
+    size_t outPos;
+    struct KvConnection* nextFollower;
+} KvConnection;
+
+typedef struct {
+    HashmapSharded store;
+    const char* primaryPath;  // NULL unless following
+
+    // primary side. The follower list only changes with every shard locked
+    pthread_mutex_t replicationLock;
+    KvConnection* followers;
+    atomic_uint_fast64_t seq;
+
+    // follower side
+    atomic_bool synced;
+    atomic_uint_fast64_t appliedSeq;
+    atomic_uint_fast64_t primarySeq;
+} KvServer;
+
+typedef struct {
+    int epfd;
+    int listenFd;
+    pthread_t thread;
+    KvServer* server;
+} KvWorker;
+
+typedef struct {
+    KvBuffer* out;
+    const char* prefix;
+    uint32_t prefixLen;
+    int failed;
+} KvScanContext;
+
+typedef struct {
+    uint64_t seq;
+    KvRequestHeader header;
+    const char* key;
+    unsigned shard;
+} KvRecordRef;
+
+static volatile sig_atomic_t kvStop = 0;
+
+static void kvHandleSignal(int sig) {
+    (void)sig;
+    kvStop = 1;
+}
+
+/**
+ * @brief Iterator that frees the entries owned by the store
+ *
+ * @param context Not used, compatibility with hashmapApplyIterator
+ * @param elem The element to be destroyed
+ * @return int -1 to remove the element
+ */
+static int kvFreeEntryIterator(void* const context, HashmapElement* const elem) {
+    (void)context;
+    free(elem->data);
+    return -1;
+}
+
+/**
+ * @brief Iterator that appends the entries matching a prefix to a scan payload
+ *
+ * @param context The KvScanContext
+ * @param elem The current element
+ * @return int 0 to keep iterating, 1 to stop if out of memory
+ */
+static int kvScanIterator(void* const context, HashmapElement* const elem) {
+    KvScanContext* scan = (KvScanContext*)context;
+    KvEntry* entry = (KvEntry*)elem->data;
+    if (scan->failed || entry->keyLen < scan->prefixLen || memcmp(entry->bytes, scan->prefix, scan->prefixLen) != 0) {
+        return 0;
+    }
+    if (kvAppendScanEntry(scan->out, entry->bytes, entry->keyLen, entry->bytes + entry->keyLen, entry->valLen)) {
+        scan->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Iterator that appends every entry as a PUT record of a snapshot
+ *
+ * @param context The KvBuffer of the follower connection
+ * @param elem The current element
+ * @return int 0 to keep iterating, 1 to stop if out of memory
+ */
+static int kvSnapshotIterator(void* const context, HashmapElement* const elem) {
+    KvEntry* entry = (KvEntry*)elem->data;
+    return kvAppendRecord((KvBuffer*)context, 0, KV_OP_PUT, entry->bytes, entry->keyLen, entry->bytes + entry->keyLen, entry->valLen);
+}
+
+static KvEntry* kvEntryCreate(const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen) {
+    KvEntry* entry = (KvEntry*)malloc(sizeof(KvEntry) + keyLen + valLen);
+    if (!entry) {
+        return NULL;
+    }
+    entry->keyLen = keyLen;
+    entry->valLen = valLen;
+    memcpy(entry->bytes, key, keyLen);
+    memcpy(entry->bytes + keyLen, val, valLen);
+    return entry;
+}
+
+/**
+ * @brief Compute function that stores a new entry and hands the replaced one back
+ *
+ * @param context Holds the new entry, gets the replaced one or NULL
+ * @param value The value slot of the key
+ * @param found If the key was there
+ * @return int 0 to store the new entry
+ */
+static int kvSwapEntry(void* const context, void** const value, const bool found) {
+    (void)found;
+    void* entry = *(void**)context;
+    *(void**)context = *value;
+    *value = entry;
+    return 0;
+}
+
+/**
+ * @brief Compute function that removes an entry and hands it back
+ *
+ * @param context Gets the removed entry, NULL if absent
+ * @param value The value slot of the key
+ * @param found If the key was there
+ * @return int -1 to remove the key, 1 if there is nothing to remove
+ */
+static int kvTakeEntry(void* const context, void** const value, const bool found) {
+    *(void**)context = *value;
+    return found ? -1 : 1;
+}
+
+/**
+ * @brief Inserts or replaces an entry. The caller holds the shard lock
+ *
+ * @param map The map of the shard
+ * @param entry The new entry, owned by the map on success
+ * @return int 0 if sucess 1 if fail
+ */
+static int kvPutLocked(Hashmap* const map, KvEntry* const entry) {
+    void* swap = entry;
+    if (hashmapCompute(map, entry->bytes, entry->keyLen, kvSwapEntry, &swap)) {
+        return 1;
+    }
+    free(swap);
+    return 0;
+}
+
+/**
+ * @brief Removes and frees an entry. The caller holds the shard lock
+ *
+ * @param map The map of the shard
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @return int 0 if it found and removed it 1 otherwise
+ */
+static int kvRemoveLocked(Hashmap* const map, const char* const key, const uint32_t keyLen) {
+    void* old = NULL;
+    hashmapCompute(map, key, keyLen, kvTakeEntry, &old);
+    if (!old) {
+        return 1;
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief Asks the owning event loop to flush a connection. The caller holds the connection lock
+ *
+ * @param conn The connection
+ */
+static void kvWakeWriter(KvConnection* const conn) {
+    if (conn->wantWrite) {
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT, .data.ptr = conn};
+    epoll_ctl(conn->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->wantWrite = true;
+}
+
+/**
+ * @brief Logs a write to every follower. The caller holds the lock of the shard
+ * written to, which keeps the order of the writes to a key in the log
+ *
+ * @param server The server
+ * @param op KV_OP_PUT or KV_OP_REMOVE
+ * @param key The key bytes
+ * @param keyLen The length of the key
+ * @param val The value bytes
+ * @param valLen The length of the value
+ */
+static void kvReplicate(KvServer* const server, const KvOp op, const char* const key, const uint32_t keyLen, const char* const val, const uint32_t valLen) {
+    // without followers the list can't change while a shard lock is held
+    if (!server->followers) {
+        atomic_fetch_add(&server->seq, 1);
+        return;
+    }
+
+    // taking the sequence under the lock keeps every stream in sequence order
+    pthread_mutex_lock(&server->replicationLock);
+    uint64_t seq = atomic_fetch_add(&server->seq, 1) + 1;
+    for (KvConnection* follower = server->followers; follower; follower = follower->nextFollower) {
+        pthread_mutex_lock(&follower->lock);
+        if (kvAppendRecord(&follower->out, seq, op, key, keyLen, val, valLen) || follower->out.len > KV_FOLLOWER_MAX_BACKLOG) {
+            // too far behind, drop it so it bootstraps again
+            shutdown(follower->fd, SHUT_RDWR);
+        } else {
+            kvWakeWriter(follower);
+        }
+        pthread_mutex_unlock(&follower->lock);
+    }
+    pthread_mutex_unlock(&server->replicationLock);
+}
+
+static void kvLockAllShards(KvServer* const server) {
+    for (unsigned i = 0; i < server->store.shardCount; i++) {
+        pthread_mutex_lock(&server->store.shards[i].lock);
+    }
+}
+
+static void kvUnlockAllShards(KvServer* const server) {
+    for (unsigned i = server->store.shardCount; i > 0; i--) {
+        pthread_mutex_unlock(&server->store.shards[i - 1].lock);
+    }
+}
+
+/**
+ * @brief Turns a connection into a replication stream, starting with a snapshot
+ *
+ * @param server The server
+ * @param conn The connection of the follower
+ * @return int 0 if sucess 1 if fail
+ */
+static int kvStartReplication(KvServer* const server, KvConnection* const conn) {
+    // no write can happen while every shard is locked, so the snapshot is
+    // exactly the state at the current sequence
+    kvLockAllShards(server);
+    pthread_mutex_lock(&server->replicationLock);
+    pthread_mutex_lock(&conn->lock);
+
+    int flag = 0;
+    for (unsigned i = 0; i < server->store.shardCount && !flag; i++) {
+        flag = hashmapApplyIterator(&server->store.shards[i].map, kvSnapshotIterator, &conn->out);
+    }
+    uint64_t seq = atomic_load(&server->seq);
+    if (!flag) {
+        flag = kvAppendRecord(&conn->out, seq, KV_OP_SYNC, NULL, 0, NULL, 0);
+    }
+    if (!flag) {
+        conn->isFollower = true;
+        conn->ackedSeq = 0;
+        conn->nextFollower = server->followers;
+        server->followers = conn;
+    }
+
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_unlock(&server->replicationLock);
+    kvUnlockAllShards(server);
+    return flag;
+}
+
+static void kvStopReplication(KvServer* const server, KvConnection* const conn) {
+    kvLockAllShards(server);
+    pthread_mutex_lock(&server->replicationLock);
+    for (KvConnection** it = &server->followers; *it; it = &(*it)->nextFollower) {
+        if (*it == conn) {
+            *it = conn->nextFollower;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->replicationLock);
+    kvUnlockAllShards(server);
+}
+
+/**
+ * @brief Appends the "name:value" statistics of the server as a response
+ *
+ * @param server The server
+ * @param out The output buffer of the connection
+ * @return int 0 if sucess 1 if fail
+ */
+static int kvAppendStats(KvServer* const server, KvBuffer* const out) {
+    char text[4096];
+    int len;
+    unsigned keys = hashmapShardedSize(&server->store);
+
+    if (server->primaryPath) {
+        uint64_t applied = atomic_load(&server->appliedSeq);
+        uint64_t primary = atomic_load(&server->primarySeq);
+        len = snprintf(text, sizeof(text), "role:follower\nkeys:%u\nsynced:%d\napplied_seq:%llu\nprimary_seq:%llu\nlag:%llu\n",
+                       keys, (int)atomic_load(&server->synced), (unsigned long long)applied, (unsigned long long)primary,
+                       (unsigned long long)(primary > applied ? primary - applied : 0));
+    } else {
+        kvLockAllShards(server);
+        pthread_mutex_lock(&server->replicationLock);
+        uint64_t seq = atomic_load(&server->seq);
+        len = snprintf(text, sizeof(text), "role:primary\nkeys:%u\nseq:%llu\n", keys, (unsigned long long)seq);
+        unsigned i = 0;
+        for (KvConnection* follower = server->followers; follower && len < (int)sizeof(text) - 64; follower = follower->nextFollower, i++) {
+            len += snprintf(text + len, sizeof(text) - (size_t)len, "follower%u_lag:%llu\n", i, (unsigned long long)(seq - follower->ackedSeq));
+        }
+        pthread_mutex_unlock(&server->replicationLock);
+        kvUnlockAllShards(server);
+    }
+
+    char header[KV_RESPONSE_HEADER_SIZE];
+    KvResponseHeader response = {.status = KV_STATUS_OK, .len = (uint32_t)len};
+    kvEncodeResponseHeader(header, &response);
+    if (kvBufferAppend(out, header, KV_RESPONSE_HEADER_SIZE)) {
+        return 1;
+    }
+    return kvBufferAppend(out, text, (size_t)len);
+}
+
+/**
+ * @brief Appends a response with no payload
+ *
+ * @param out The output buffer of the connection
+ * @param status The status of the response
+ * @return int 0 if sucess 1 if fail
+ */
+static int kvRespond(KvBuffer* const out, const KvStatus status) {
+    char header[KV_RESPONSE_HEADER_SIZE];
+    KvResponseHeader response = {.status = (uint8_t)status, .len = 0};
+    kvEncodeResponseHeader(header, &response);
+    return kvBufferAppend(out, header, KV_RESPONSE_HEADER_SIZE);
+}
+
+/**
+ * @brief Executes one request and appends its response
+ *
+ * @param server The server
+ * @param conn The connection the request came from
+ * @param request The request header
+ * @param key The key bytes of the request
+ * @param val The value bytes of the request
+ * @return int 0 if sucess 1 if fail
+ */
+static int kvExecute(KvServer* const server, KvConnection* const conn, const KvRequestHeader* const request, const char* const key, const char* const val) {
+    HashmapSharded* store = &server->store;
+    KvBuffer* out = &conn->out;
+
+    // a replication stream only carries acknowledgements back
+    if (conn->isFollower) {
+        if (request->op != KV_OP_ACK || request->valLen != sizeof(uint64_t)) {
+            return 1;
+        }
+        pthread_mutex_lock(&conn->lock);
+        memcpy(&conn->ackedSeq, val, sizeof(uint64_t));
+        int flag = kvAppendRecord(out, atomic_load(&server->seq), KV_OP_ACK, NULL, 0, NULL, 0);
+        pthread_mutex_unlock(&conn->lock);
+        return flag;
+    }
+
+    switch (request->op) {
+        case KV_OP_GET: {
+            HashmapShard* shard = hashmapShardedShardFor(store, key, request->keyLen);
+            pthread_mutex_lock(&shard->lock);
+            KvEntry* entry = (KvEntry*)hashmapGet(&shard->map, key, request->keyLen);
+            int flag;
+            if (entry) {
+                // copy the value while the shard lock keeps the entry alive
+                char header[KV_RESPONSE_HEADER_SIZE];
+                KvResponseHeader response = {.status = KV_STATUS_OK, .len = entry->valLen};
+                kvEncodeResponseHeader(header, &response);
+                flag = kvBufferReserve(out, KV_RESPONSE_HEADER_SIZE + entry->valLen);
+                if (!flag) {
+                    kvBufferAppend(out, header, KV_RESPONSE_HEADER_SIZE);
+                    kvBufferAppend(out, entry->bytes + entry->keyLen, entry->valLen);
+                }
+            } else {
+                flag = kvRespond(out, KV_STATUS_NOT_FOUND);
+            }
+            pthread_mutex_unlock(&shard->lock);
+            return flag;
+        }
+        case KV_OP_PUT: {
+            // followers only change through the replication stream
+            if (server->primaryPath) {
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+
+            // build the entry before taking the lock
+            KvEntry* entry = kvEntryCreate(key, request->keyLen, val, request->valLen);
+            if (!entry) {
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+
+            HashmapShard* shard = hashmapShardedShardFor(store, key, request->keyLen);
+            pthread_mutex_lock(&shard->lock);
+            int flag = kvPutLocked(&shard->map, entry);
+            if (!flag) {
+                kvReplicate(server, KV_OP_PUT, key, request->keyLen, val, request->valLen);
+            }
+            pthread_mutex_unlock(&shard->lock);
+
+            if (flag) {
+                free(entry);
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+            return kvRespond(out, KV_STATUS_OK);
+        }
+        case KV_OP_REMOVE: {
+            if (server->primaryPath) {
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+
+            HashmapShard* shard = hashmapShardedShardFor(store, key, request->keyLen);
+            pthread_mutex_lock(&shard->lock);
+            int flag = kvRemoveLocked(&shard->map, key, request->keyLen);
+            if (!flag) {
+                kvReplicate(server, KV_OP_REMOVE, key, request->keyLen, NULL, 0);
+            }
+            pthread_mutex_unlock(&shard->lock);
+
+            return kvRespond(out, flag ? KV_STATUS_NOT_FOUND : KV_STATUS_OK);
+        }
+        case KV_OP_SCAN: {
+            // a cursor as value asks for a single slice of one shard
+            bool stepped = request->valLen == sizeof(uint64_t);
+            uint64_t cursor = 0;
+            if (stepped) {
+                memcpy(&cursor, val, sizeof(uint64_t));
+                if ((cursor >> 32) >= store->shardCount) {
+                    return kvRespond(out, KV_STATUS_ERROR);
+                }
+            }
+
+            // reserve the header and cursor, they are only known at the end
+            size_t headerPos = out->len;
+            size_t reserved = KV_RESPONSE_HEADER_SIZE + (stepped ? sizeof(uint64_t) : 0);
+            if (kvBufferReserve(out, reserved)) {
+                return 1;
+            }
+            out->len += reserved;
+
+            KvScanContext scan = {.out = out, .prefix = key, .prefixLen = request->keyLen, .failed = 0};
+            if (stepped) {
+                unsigned shardIndex = (unsigned)(cursor >> 32);
+                HashmapShard* shard = &store->shards[shardIndex];
+                pthread_mutex_lock(&shard->lock);
+                unsigned next = hashmapScan(&shard->map, (unsigned)cursor, KV_SCAN_STEP, kvScanIterator, &scan);
+                pthread_mutex_unlock(&shard->lock);
+
+                if (next) {
+                    cursor = ((uint64_t)shardIndex << 32) | next;
+                } else {
+                    cursor = (shardIndex + 1 < store->shardCount) ? (uint64_t)(shardIndex + 1) << 32 : 0;
+                }
+                memcpy(out->data + headerPos + KV_RESPONSE_HEADER_SIZE, &cursor, sizeof(uint64_t));
+            } else {
+                for (unsigned i = 0; i < store->shardCount && !scan.failed; i++) {
+                    pthread_mutex_lock(&store->shards[i].lock);
+                    hashmapApplyIterator(&store->shards[i].map, kvScanIterator, &scan);
+                    pthread_mutex_unlock(&store->shards[i].lock);
+                }
+            }
+
+            size_t payloadLen = out->len - headerPos - KV_RESPONSE_HEADER_SIZE;
+            if (scan.failed || payloadLen > KV_MAX_PAYLOAD) {
+                out->len = headerPos;
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+            KvResponseHeader response = {.status = KV_STATUS_OK, .len = (uint32_t)payloadLen};
+            kvEncodeResponseHeader(out->data + headerPos, &response);
+            return 0;
+        }
+        case KV_OP_STATS:
+            return kvAppendStats(server, out);
+        case KV_OP_REPLICATE:
+            // chained replication is not supported
+            if (server->primaryPath) {
+                return kvRespond(out, KV_STATUS_ERROR);
+            }
+            return kvStartReplication(server, conn);
+        default:
+            return kvRespond(out, KV_STATUS_ERROR);
+    }
+}
+
+/**
+ * @brief Executes every complete request in the input buffer
+ *
+ * @param server The server
+ * @param conn The connection
+ * @return int 0 if sucess 1 if the connection must be closed
+ */
+static int kvProcessInput(KvServer* const server, KvConnection* const conn) {
+    size_t pos = 0;
+    while (conn->in.len - pos >= KV_REQUEST_HEADER_SIZE) {
+        KvRequestHeader request;
+        kvDecodeRequestHeader(conn->in.data + pos, &request);
+        if (request.keyLen > KV_MAX_PAYLOAD || request.valLen > KV_MAX_PAYLOAD) {
+            return 1;
+        }
+
+        size_t total = KV_REQUEST_HEADER_SIZE + (size_t)request.keyLen + request.valLen;
+        if (conn->in.len - pos < total) {
+            break;
+        }
+
+        const char* key = conn->in.data + pos + KV_REQUEST_HEADER_SIZE;
+        if (kvExecute(server, conn, &request, key, key + request.keyLen)) {
+            return 1;
+        }
+        pos += total;
+    }
+
+    kvBufferConsume(&conn->in, pos);
+    return 0;
+}
+
+/**
+ * @brief Writes as much of the pending output as the socket takes
+ *
+ * @param conn The connection
+ * @return int 0 if sucess 1 if the connection must be closed
+ */
+static int kvFlushOutput(KvConnection* const conn) {
+    if (conn->isFollower) {
+        pthread_mutex_lock(&conn->lock);
+    }
+
+    int flag = 0;
+    while (conn->outPos < conn->out.len) {
+        ssize_t n = write(conn->fd, conn->out.data + conn->outPos, conn->out.len - conn->outPos);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                flag = 1;
+            }
+            break;
+        }
+        conn->outPos += (size_t)n;
+    }
+
+    if (conn->outPos == conn->out.len) {
+        conn->out.len = 0;
+        conn->outPos = 0;
+    }
+
+    // only ask for writability while there is something left to send
+    bool wantWrite = conn->out.len != 0;
+    if (!flag && wantWrite != conn->wantWrite) {
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? EPOLLOUT : 0), .data.ptr = conn};
+        flag = epoll_ctl(conn->epfd, EPOLL_CTL_MOD, conn->fd, &ev) != 0;
+        conn->wantWrite = wantWrite;
+    }
+
+    if (conn->isFollower) {
+        pthread_mutex_unlock(&conn->lock);
+    }
+    return flag;
+}
+
+/**
+ * @brief Reads everything available on a connection and serves it
+ *
+ * @param server The server
+ * @param conn The connection
+ * @return int 0 if sucess 1 if the connection must be closed
+ */
+static int kvHandleReadable(KvServer* const server, KvConnection* const conn) {
+    while (1) {
+        if (kvBufferReserve(&conn->in, KV_READ_CHUNK)) {
+            return 1;
+        }
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.len, conn->in.cap - conn->in.len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return 1;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        conn->in.len += (size_t)n;
+    }
+
+    if (kvProcessInput(server, conn)) {
+        return 1;
+    }
+    return kvFlushOutput(conn);
+}
+
+static void kvCloseConnection(KvServer* const server, KvConnection* const conn) {
+    if (conn->isFollower) {
+        kvStopReplication(server, conn);
+    }
+    epoll_ctl(conn->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    kvBufferFree(&conn->in);
+    kvBufferFree(&conn->out);
+    free(conn);
+}
+
+static void kvAcceptConnections(KvWorker* const worker) {
+    while (1) {
+        int fd = accept4(worker->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        KvConnection* conn = (KvConnection*)calloc(1, sizeof(KvConnection));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->epfd = worker->epfd;
+        pthread_mutex_init(&conn->lock, NULL);
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+        if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            close(fd);
+            pthread_mutex_destroy(&conn->lock);
+            free(conn);
+        }
+    }
+}
+
+static void* kvWorkerRun(void* const arg) {
+    KvWorker* worker = (KvWorker*)arg;
+    struct epoll_event events[KV_MAX_EVENTS];
+
+    while (!kvStop) {
+        int n = epoll_wait(worker->epfd, events, KV_MAX_EVENTS, 200);
+        for (int i = 0; i < n; i++) {
+            KvConnection* conn = (KvConnection*)events[i].data.ptr;
+            if (!conn) {
+                kvAcceptConnections(worker);
+                continue;
+            }
+
+            int closeConn = 0;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConn = 1;
+            }
+            if (!closeConn && (events[i].events & EPOLLOUT)) {
+                closeConn = kvFlushOutput(conn);
+            }
+            if (!closeConn && (events[i].events & (EPOLLIN | EPOLLRDHUP))) {
+                closeConn = kvHandleReadable(worker->server, conn);
+            }
+            if (closeConn) {
+                kvCloseConnection(worker->server, conn);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Applies a batch of replication records, locking each shard only once
+ *
+ * @param server The follower server
+ * @param records The parsed records, in stream order
+ * @param count The number of records
+ * @param order Scratch space for count indexes
+ */
+static void kvApplyRecords(KvServer* const server, const KvRecordRef* const records, const unsigned count, unsigned* const order) {
+    HashmapSharded* store = &server->store;
+
+    // stable counting sort by shard keeps the order of the writes to each key
+    unsigned* starts = (unsigned*)calloc(store->shardCount + 1, sizeof(unsigned));
+    if (!starts) {
+        for (unsigned i = 0; i < count; i++) {
+            order[i] = i;
+        }
+    } else {
+        for (unsigned i = 0; i < count; i++) {
+            starts[records[i].shard + 1]++;
+        }
+        for (unsigned s = 0; s < store->shardCount; s++) {
+            starts[s + 1] += starts[s];
+        }
+        for (unsigned i = 0; i < count; i++) {
+            order[starts[records[i].shard]++] = i;
+        }
+        free(starts);
+    }
+
+    unsigned i = 0;
+    while (i < count) {
+        HashmapShard* shard = &store->shards[records[order[i]].shard];
+        pthread_mutex_lock(&shard->lock);
+        for (; i < count && &store->shards[records[order[i]].shard] == shard; i++) {
+            const KvRecordRef* record = &records[order[i]];
+            if (record->header.op == KV_OP_PUT) {
+                KvEntry* entry = kvEntryCreate(record->key, record->header.keyLen, record->key + record->header.keyLen, record->header.valLen);
+                if (!entry || kvPutLocked(&shard->map, entry)) {
+                    free(entry);
+                    printf("Couldn't apply a replicated put!\n");
+                }
+            } else {
+                kvRemoveLocked(&shard->map, record->key, record->header.keyLen);
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/**
+ * @brief Parses and applies every complete record of the stream buffer
+ *
+ * @param server The follower server
+ * @param stream The bytes received from the primary
+ * @param outAck Set if records were applied and the primary should be told
+ * @return size_t The number of bytes consumed, or (size_t)-1 if the stream is malformed
+ */
+static size_t kvApplyStream(KvServer* const server, const KvBuffer* const stream, bool* const outAck) {
+    size_t pos = 0;
+    unsigned count = 0;
+    unsigned cap = 0;
+    KvRecordRef* records = NULL;
+    uint64_t applied = 0;
+    bool synced = false;
+
+    while (stream->len - pos >= KV_RECORD_HEADER_SIZE) {
+        KvRecordRef record;
+        kvDecodeRecordHeader(stream->data + pos, &record.seq, &record.header);
+        size_t total = KV_RECORD_HEADER_SIZE + (size_t)record.header.keyLen + record.header.valLen;
+        if (record.header.keyLen > KV_MAX_PAYLOAD || record.header.valLen > KV_MAX_PAYLOAD) {
+            free(records);
+            return (size_t)-1;
+        }
+        if (stream->len - pos < total) {
+            break;
+        }
+        record.key = stream->data + pos + KV_RECORD_HEADER_SIZE;
+        pos += total;
+
+        switch (record.header.op) {
+            case KV_OP_ACK:
+                atomic_store(&server->primarySeq, record.seq);
+                continue;
+            case KV_OP_SYNC:
+                applied = record.seq;
+                synced = true;
+                continue;
+            case KV_OP_PUT:
+            case KV_OP_REMOVE:
+                break;
+            default:
+                free(records);
+                return (size_t)-1;
+        }
+
+        if (count == cap) {
+            cap = cap ? 2 * cap : 1024;
+            KvRecordRef* grown = (KvRecordRef*)realloc(records, (size_t)cap * sizeof(KvRecordRef));
+            if (!grown) {
+                free(records);
+                return (size_t)-1;
+            }
+            records = grown;
+        }
+        record.shard = (unsigned)(hashmapShardedShardFor(&server->store, record.key, record.header.keyLen) - server->store.shards);
+        records[count++] = record;
+        if (record.seq > applied) {
+            applied = record.seq;
+        }
+    }
+
+    if (count) {
+        unsigned* order = (unsigned*)malloc(count * sizeof(unsigned));
+        if (!order) {
+            free(records);
+            return (size_t)-1;
+        }
+        kvApplyRecords(server, records, count, order);
+        free(order);
+    }
+    free(records);
+
+    if (synced) {
+        atomic_store(&server->synced, true);
+    }
+    if (count || synced) {
+        // the stream is in sequence order, so the last record is the newest
+        if (applied) {
+            atomic_store(&server->appliedSeq, applied);
+        }
+        if (atomic_load(&server->primarySeq) < applied) {
+            atomic_store(&server->primarySeq, applied);
+        }
+        *outAck = true;
+    }
+    return pos;
+}
+
+/**
+ * @brief Follows the primary until the stream breaks or the server stops
+ *
+ * @param server The follower server
+ * @param primary The connection to the primary, already sent KV_OP_REPLICATE
+ */
+static void kvFollowStream(KvServer* const server, KvClient* const primary) {
+    // wake up regularly to notice a shutdown
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = 200000};
+    setsockopt(primary->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    while (!kvStop) {
+        if (kvBufferReserve(&primary->in, KV_READ_CHUNK)) {
+            return;
+        }
+        ssize_t n = read(primary->fd, primary->in.data + primary->in.len, primary->in.cap - primary->in.len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        primary->in.len += (size_t)n;
+
+        bool ack = false;
+        size_t used = kvApplyStream(server, &primary->in, &ack);
+        if (used == (size_t)-1) {
+            return;
+        }
+        kvBufferConsume(&primary->in, used);
+
+        if (ack) {
+            uint64_t applied = atomic_load(&server->appliedSeq);
+            if (kvClientQueue(primary, KV_OP_ACK, NULL, 0, (const char*)&applied, sizeof(uint64_t)) || kvClientFlush(primary)) {
+                return;
+            }
+        }
+    }
+}
+
+static void* kvFollowerRun(void* const arg) {
+    KvServer* server = (KvServer*)arg;
+
+    while (!kvStop) {
+        KvClient primary;
+        if (kvClientConnect(server->primaryPath, &primary) ||
+            kvClientQueue(&primary, KV_OP_REPLICATE, NULL, 0, NULL, 0) ||
+            kvClientFlush(&primary)) {
+            kvClientClose(&primary);
+            sleep(1);
+            continue;
+        }
+
+        // a fresh snapshot follows, drop whatever an earlier stream left
+        atomic_store(&server->synced, false);
+        atomic_store(&server->appliedSeq, 0);
+        atomic_store(&server->primarySeq, 0);
+        kvLockAllShards(server);
+        for (unsigned i = 0; i < server->store.shardCount; i++) {
+            hashmapApplyIterator(&server->store.shards[i].map, kvFreeEntryIterator, NULL);
+        }
+        kvUnlockAllShards(server);
+
+        kvFollowStream(server, &primary);
+        kvClientClose(&primary);
+        if (!kvStop) {
+            printf("Lost the primary, bootstrapping again\n");
+        }
+    }
+
+    return NULL;
+}
+
+static int kvListen(const char* const path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    long workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    static KvServer server;
+    const char* tracePath = NULL;
+    bool traceHashed = false;
+    unsigned long maintainBudgetUs = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:f:t:T:m:")) != -1) {
+        switch (opt) {
+            case 'w':
+                workerCount = strtol(optarg, NULL, 10);
+                break;
+            case 'f':
+                if (strlen(optarg) >= sizeof(((struct sockaddr_un*)NULL)->sun_path)) {
+                    printf("The primary socket path %s is too long!\n", optarg);
+                    return 1;
+                }
+                server.primaryPath = optarg;
+                break;
+            case 't':
+            case 'T':
+                tracePath = optarg;
+                traceHashed = opt == 'T';
+                break;
+            case 'm':
+                maintainBudgetUs = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                printf("Usage: kvserver [-w worker threads] [-f primary socket path] [-t|-T trace path] [-m maintenance budget us] [socket path]\n");
+                return 1;
+        }
+    }
+    const char* path = (optind < argc) ? argv[optind] : KV_DEFAULT_SOCKET;
+    if (workerCount <= 0) {
+        workerCount = 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = kvHandleSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (hashmapShardedCreate(0, 1024, &server.store)) {
+        printf("Couldn't create the store!\n");
+        return 1;
+    }
+    for (unsigned i = 0; i < server.store.shardCount; i++) {
+        hashmapAutoShrink(&server.store.shards[i].map, KV_SHRINK_LOW_WATER);
+    }
+    pthread_mutex_init(&server.replicationLock, NULL);
+    if (maintainBudgetUs && hashmapShardedStartMaintenance(&server.store, KV_MAINTAIN_INTERVAL_MS, maintainBudgetUs * 1000)) {
+        printf("Couldn't start the maintenance thread!\n");
+        return 1;
+    }
+
+    if (tracePath) {
+#ifndef HASHMAP_TRACE
+        printf("Built without TRACE=1, the trace will stay empty\n");
+#endif
+        if (hashmapTraceOpen(tracePath, traceHashed)) {
+            printf("Couldn't open the trace %s!\n", tracePath);
+            return 1;
+        }
+    }
+
+    int listenFd = kvListen(path);
+    if (listenFd < 0) {
+        printf("Couldn't listen on %s!\n", path);
+        hashmapShardedDestroy(&server.store);
+        return 1;
+    }
+
+    KvWorker* workers = (KvWorker*)calloc((size_t)workerCount, sizeof(KvWorker));
+    if (!workers) {
+        printf("Couldn't create the workers!\n");
+        return 1;
+    }
+    for (long i = 0; i < workerCount; i++) {
+        workers[i].listenFd = listenFd;
+        workers[i].server = &server;
+        workers[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+
+        // EPOLLEXCLUSIVE wakes a single worker per incoming connection
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+        if (workers[i].epfd < 0 || epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, listenFd, &ev)) {
+            printf("Couldn't create the event loop!\n");
+            return 1;
+        }
+        pthread_create(&workers[i].thread, NULL, kvWorkerRun, &workers[i]);
+    }
+
+    pthread_t follower;
+    if (server.primaryPath) {
+        pthread_create(&follower, NULL, kvFollowerRun, &server);
+        printf("Following %s, serving reads of %u shards with %ld workers on %s\n", server.primaryPath, server.store.shardCount, workerCount, path);
+    } else {
+        printf("Serving %u shards with %ld workers on %s\n", server.store.shardCount, workerCount, path);
+    }
+    fflush(stdout);
+
+    for (long i = 0; i < workerCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epfd);
+    }
+    if (server.primaryPath) {
+        pthread_join(follower, NULL);
+    }
+    free(workers);
+    close(listenFd);
+    unlink(path);
+
+    printf("Shutting down with %u keys\n", hashmapShardedSize(&server.store));
+    hashmapTraceClose();
+    pthread_mutex_destroy(&server.replicationLock);
+    hashmapShardedDestroyWithOwnership(&server.store, kvFreeEntryIterator);
+    return 0;
+}
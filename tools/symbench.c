@@ -0,0 +1,283 @@
+/**
+ * @file symbench.c
+ * @brief Symbol table workload generator and benchmark
+ *
+ * Replays what a compiler does to its symbol table: identifiers drawn from
+ * a Zipf distribution, so a few names like i or tmp come back all the time,
+ * nested scopes that declare, shadow and look up names, and scope exits
+ * that drop their declarations and bring the shadowed ones back. Procedures
+ * are only declared at the outermost scope.
+ *
+ * Usage: symbench [operations] [vocabulary] [zipf exponent] [seed]
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../header/symbolTable.h"
+
+#define SYM_BENCH_MAX_DEPTH 32
+#define SYM_BENCH_NAME_SIZE 32
+
+// what a scope exit has to undo: the name declared and what it shadowed
+typedef struct {
+    unsigned rank;
+    void* shadowed;
+} SymBenchDecl;
+
+typedef struct {
+    SymBenchDecl* decls;
+    unsigned count;
+    unsigned cap;
+} SymBenchScope;
+
+typedef struct {
+    unsigned long declarations;
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long scopes;
+    unsigned live;  // records, shadowed ones included
+    unsigned peakLive;
+    size_t recordBytes;
+    size_t peakBytes;
+    size_t peakTableBytes;
+} SymBenchStats;
+
+static const char* const symBenchStems[] = {"i", "j", "n", "x", "tmp", "len", "count", "index", "result", "value",
+                                            "node", "ptr", "offset", "buffer", "size", "key", "item", "state"};
+
+static double symNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t symRandom(uint64_t* const state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double symUniform(uint64_t* const state) {
+    return (double)(symRandom(state) >> 11) / 9007199254740992.0;
+}
+
+/**
+ * @brief Builds the identifiers, most frequent first: the bare stems, then numbered variants
+ *
+ * @param vocabulary The number of identifiers
+ * @return char* vocabulary names of SYM_BENCH_NAME_SIZE bytes each
+ */
+static char* symBenchNames(const unsigned vocabulary) {
+    char* names = (char*)malloc((size_t)vocabulary * SYM_BENCH_NAME_SIZE);
+    if (!names) {
+        return NULL;
+    }
+    const unsigned stems = sizeof(symBenchStems) / sizeof(symBenchStems[0]);
+    for (unsigned r = 0; r < vocabulary; r++) {
+        char* name = names + (size_t)r * SYM_BENCH_NAME_SIZE;
+        if (r < stems) {
+            snprintf(name, SYM_BENCH_NAME_SIZE, "%s", symBenchStems[r]);
+        } else {
+            snprintf(name, SYM_BENCH_NAME_SIZE, "%s_%u", symBenchStems[r % stems], r / stems);
+        }
+    }
+    return names;
+}
+
+/**
+ * @brief Builds the cumulative Zipf distribution over the identifier ranks
+ *
+ * @param vocabulary The number of identifiers
+ * @param exponent The Zipf exponent, about 1 for identifiers
+ * @return double* The cumulative probability of every rank
+ */
+static double* symBenchZipf(const unsigned vocabulary, const double exponent) {
+    double* cdf = (double*)malloc(vocabulary * sizeof(double));
+    if (!cdf) {
+        return NULL;
+    }
+    double total = 0;
+    for (unsigned r = 0; r < vocabulary; r++) {
+        total += 1.0 / pow(r + 1, exponent);
+        cdf[r] = total;
+    }
+    for (unsigned r = 0; r < vocabulary; r++) {
+        cdf[r] /= total;
+    }
+    return cdf;
+}
+
+static unsigned symBenchDraw(const double* const cdf, const unsigned vocabulary, uint64_t* const rng) {
+    double u = symUniform(rng);
+    unsigned lo = 0, hi = vocabulary - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static const char* symBenchName(const void* const record) {
+    return *(const bool*)record ? ((const struct _var*)record)->name : ((const struct _proc*)record)->name;
+}
+
+static int symBenchRemember(SymBenchScope* const scope, const unsigned rank, void* const shadowed) {
+    if (scope->count == scope->cap) {
+        unsigned cap = scope->cap ? scope->cap * 2 : 16;
+        SymBenchDecl* decls = (SymBenchDecl*)realloc(scope->decls, cap * sizeof(SymBenchDecl));
+        if (!decls) {
+            return 1;
+        }
+        scope->decls = decls;
+        scope->cap = cap;
+    }
+    scope->decls[scope->count].rank = rank;
+    scope->decls[scope->count].shadowed = shadowed;
+    scope->count++;
+    return 0;
+}
+
+/**
+ * @brief Drops the declarations of a scope, newest first, bringing back what they shadowed
+ *
+ * @param symbolTable The symbol table
+ * @param scope The scope to leave
+ * @param names The identifiers
+ * @param stats The running statistics
+ */
+static void symBenchLeave(Hashmap* const symbolTable, SymBenchScope* const scope, const char* const names, SymBenchStats* const stats) {
+    while (scope->count) {
+        SymBenchDecl* decl = &scope->decls[--scope->count];
+        const char* name = names + (size_t)decl->rank * SYM_BENCH_NAME_SIZE;
+        unsigned len = (unsigned)strlen(name);
+
+        void* current = hashmapGet(symbolTable, name, len);
+        if (!current) {
+            continue;
+        }
+        stats->recordBytes -= *(bool*)current ? sizeof(struct _var) : sizeof(struct _proc);
+        stats->live--;
+        if (decl->shadowed) {
+            // the key has to point at the record brought back, the current one owns the old key
+            hashmapPut(symbolTable, symBenchName(decl->shadowed), len, decl->shadowed);
+        } else {
+            hashmapRemove(symbolTable, name, len);
+        }
+        free(current);
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned long operations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 5000000;
+    unsigned vocabulary = (argc > 2) ? (unsigned)strtoul(argv[2], NULL, 10) : 50000;
+    double exponent = (argc > 3) ? strtod(argv[3], NULL) : 1.1;
+    uint64_t rng = (argc > 4) ? strtoull(argv[4], NULL, 10) : 42;
+    if (vocabulary == 0 || rng == 0) {
+        printf("Usage: symbench [operations] [vocabulary] [zipf exponent] [seed]\n");
+        return 1;
+    }
+
+    char* names = symBenchNames(vocabulary);
+    double* cdf = symBenchZipf(vocabulary, exponent);
+    SymBenchScope* scopes = (SymBenchScope*)calloc(SYM_BENCH_MAX_DEPTH, sizeof(SymBenchScope));
+    Hashmap symbolTable;
+    if (!names || !cdf || !scopes || hashmapCreate(2, &symbolTable)) {
+        printf("Couldn't set up the benchmark!\n");
+        return 1;
+    }
+
+    SymBenchStats stats = {0};
+    unsigned depth = 0;
+    int flag = 0;
+    double start = symNow();
+    for (unsigned long op = 0; op < operations && !flag; op++) {
+        unsigned roll = (unsigned)(symRandom(&rng) >> 32) % 100;
+        if (roll < 5 && depth + 1 < SYM_BENCH_MAX_DEPTH) {
+            depth++;
+            stats.scopes++;
+            continue;
+        }
+        if (roll < 10 && depth > 0) {
+            symBenchLeave(&symbolTable, &scopes[depth--], names, &stats);
+            continue;
+        }
+
+        unsigned rank = symBenchDraw(cdf, vocabulary, &rng);
+        char* name = names + (size_t)rank * SYM_BENCH_NAME_SIZE;
+        unsigned len = (unsigned)strlen(name);
+        void* shadowed = hashmapGet(&symbolTable, name, len);
+
+        if (roll < 35) {
+            // shadowed records, even from the same scope, stay alive until the scope exit.
+            // Remembered first, so a declaration that can't be undone is never made
+            flag = symBenchRemember(&scopes[depth], rank, shadowed);
+            if (flag) {
+                continue;
+            }
+            // a declaration, procedures only at the outermost scope
+            size_t recordBytes;
+            if (depth == 0 && roll < 13) {
+                flag = insertProc(&symbolTable, name, (int)(rank & 1), (unsigned)op);
+                recordBytes = sizeof(struct _proc);
+            } else {
+                flag = insertVar(&symbolTable, name, (int)(rank & 1), (union v)(int)rank, depth);
+                recordBytes = sizeof(struct _var);
+            }
+            if (flag) {
+                scopes[depth].count--;
+                continue;
+            }
+            stats.recordBytes += recordBytes;
+            stats.declarations++;
+            stats.live++;
+            if (stats.live > stats.peakLive) {
+                stats.peakLive = stats.live;
+                stats.peakBytes = stats.recordBytes;
+                stats.peakTableBytes = (size_t)symbolTable.tableSize * sizeof(HashmapElement);
+            }
+        } else {
+            stats.lookups++;
+            stats.hits += shadowed != NULL;
+        }
+    }
+    double elapsed = symNow() - start;
+
+    for (unsigned d = depth + 1; d-- > 0;) {
+        symBenchLeave(&symbolTable, &scopes[d], names, &stats);
+    }
+    for (unsigned d = 0; d < SYM_BENCH_MAX_DEPTH; d++) {
+        free(scopes[d].decls);
+    }
+
+    if (flag) {
+        printf("Out of memory!\n");
+    } else {
+        unsigned peak = stats.peakLive ? stats.peakLive : 1;
+        printf("%lu operations in %.3fs: %.0f symbols/s, %.0f operations/s\n", operations, elapsed,
+               (double)stats.declarations / elapsed, (double)operations / elapsed);
+        printf("%lu declarations, %lu lookups (%.1f%% hits), %lu scopes\n", stats.declarations, stats.lookups,
+               stats.lookups ? 100.0 * (double)stats.hits / (double)stats.lookups : 0.0, stats.scopes);
+        printf("peak %u live symbols, %.1f bytes/symbol (table %.1f, records %.1f)\n", stats.peakLive,
+               (double)(stats.peakTableBytes + stats.peakBytes) / peak, (double)stats.peakTableBytes / peak,
+               (double)stats.peakBytes / peak);
+    }
+
+    hashmapDestroy(&symbolTable);
+    free(scopes);
+    free(cdf);
+    free(names);
+    return flag;
+}